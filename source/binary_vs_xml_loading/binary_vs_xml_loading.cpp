@@ -132,28 +132,24 @@ int main()
 	test.resize(32768);
 
 	{
-		xr::TIME_SCOPE t;
+		PROFILE_ZONE("bin_write");
 		STREAM_WRITE_BINARY swb("stream.bin");
 		serialize(swb, "test", test);
-		printf("Bin write: %d ms\n", t.measure_duration_ms());
 	}
 	{
-		xr::TIME_SCOPE t;
+		PROFILE_ZONE("xml_write");
 		STREAM_WRITE_XML swx("stream.xml");
 		serialize(swx, "test", test);
-		printf("Xml write: %d ms\n", t.measure_duration_ms());
 	}
 	{
-		xr::TIME_SCOPE t;
+		PROFILE_ZONE("bin_read");
 		STREAM_READ_BINARY srb("stream.bin");
 		serialize(srb, "test", test);
-		printf("Bin read: %d ms\n", t.measure_duration_ms());
 	}
 	{
-		xr::TIME_SCOPE t;
+		PROFILE_ZONE("xml_read");
 		STREAM_READ_XML srx("stream.xml");
 		serialize(srx, "test", test);
-		printf("Xml read: %d ms\n", t.measure_duration_ms());
 	}
 
 
@@ -5,7 +5,9 @@
 #include <xr/mesh_simplifier.h>
 #include <xr/heightfield_simplifier.h>
 #include <xr/mesh.h>
+#include <xr/file.h>
 #include <xr/time.h>
+#include <xr/job_manager.h>
 
 //#define SIMPLIFICATION_RATIO	0.15f    // how much from the original mesh we would like to keep as face count
 #define SIMPLIFICATION_EPSILON 0.0136f
@@ -29,25 +31,23 @@ struct TEST
 
 bool load_heightfield(const char* file, float max_height, xr::VECTOR<float>& hf)
 {
-	FILE* fp = fopen(file, "rb");
+	xr::FILE* fp = xr::FILE::open(file, xr::FILE::READ | xr::FILE::MMAP);
 	if (!fp) return false;
-	fseek(fp, 0, SEEK_END);
-	hf.resize(ftell(fp));
-	fseek(fp, 0, SEEK_SET);
 
 	const float scale = max_height / 255.0f;
 
-	unsigned char* buf = new unsigned char[hf.size()];
-	fread(buf, 1, hf.size(), fp);
-	fclose(fp);
+	const u8* buf = fp->data();
+	hf.resize(fp->size());
 	for (int i = 0; i < hf.size(); ++i)
 		hf[i] = float(buf[i]) * scale;
-	delete[] buf;
+	delete fp;
 	return true;
 }
 
 int main()
 {
+	xr::jobs_init(0);
+
 	xr::VECTOR<float> heightfield;
 
 	load_heightfield(INPUT_FILENAME, 1.0f, heightfield);
@@ -70,50 +70,55 @@ int main()
 	}
 #endif
 
-	xr::TIME_SCOPE time;
-
+	{
+		PROFILE_ZONE("simplify");
 #ifdef SIMPLIFICATION_RATIO
 
-	float epsilon_l = 0.0f, epsilon_r = 0.0f;
+		float epsilon_l = 0.0f, epsilon_r = 0.0f;
 
-	for (int y = 0; y < H - 1; ++y) {
-		const float* ptr = &heightfield[y*W];
-		for (int x = 0; x < W - 1; ++x) {
-			float dx = fabsf(ptr[0] - ptr[1]), dy = fabsf(ptr[0] - ptr[W]);
-			if (dx > epsilon_r) epsilon_r = dx;
-			if (dy > epsilon_r) epsilon_r = dy;
+		for (int y = 0; y < H - 1; ++y) {
+			const float* ptr = &heightfield[y*W];
+			for (int x = 0; x < W - 1; ++x) {
+				float dx = fabsf(ptr[0] - ptr[1]), dy = fabsf(ptr[0] - ptr[W]);
+				if (dx > epsilon_r) epsilon_r = dx;
+				if (dy > epsilon_r) epsilon_r = dy;
+			}
 		}
-	}
 
-	const int target_vertices = W * H * SIMPLIFICATION_RATIO;
-	for (int i = 0; i < 6; ++i)
-	{
-		const float epsilon = (epsilon_l + epsilon_r)*0.5f;
+		const int target_vertices = W * H * SIMPLIFICATION_RATIO;
+		for (int i = 0; i < 6; ++i)
+		{
+			const float epsilon = (epsilon_l + epsilon_r)*0.5f;
 
-		mesh_hf.clear();
+			mesh_hf.clear();
 
-		xr::heightfield_simplify(&heightfield[0], &mask[0], W, H, XY_SCALE, HOLE_VALUE, xr::Max(W / 16, H / 16), epsilon, mesh_hf);
-		if (mesh_hf.positions.size() > target_vertices )
-			epsilon_l = epsilon;
-		else
-			epsilon_r = epsilon;
-	}
+			xr::heightfield_simplify(&heightfield[0], &mask[0], W, H, XY_SCALE, HOLE_VALUE, xr::Max(W / 16, H / 16), epsilon, mesh_hf);
+			if (mesh_hf.m_positions.size() > target_vertices )
+				epsilon_l = epsilon;
+			else
+				epsilon_r = epsilon;
+		}
 #elif defined(SIMPLIFICATION_EPSILON)
 
-	xr::heightfield_simplify(&heightfield[0], &mask[0], W, H, XY_SCALE, HOLE_VALUE, xr::Max(W / 16, H / 16), SIMPLIFICATION_EPSILON, mesh_hf);
+		xr::heightfield_simplify(&heightfield[0], &mask[0], W, H, XY_SCALE, HOLE_VALUE, xr::Max(W / 16, H / 16), SIMPLIFICATION_EPSILON, mesh_hf);
 
 #endif
+	}
 
-	char pc[256];
-	sprintf(pc, "Simplify took %d ms\n", time.measure_duration_ms());
-	OutputDebugStringA(pc);
-
-	time.reset();
-
-	mesh_hf.write_obj(OUTPUT_FILENAME);
+	xr::MESH::VERTEX_CACHE_STATS before, after;
+	{
+		PROFILE_ZONE("optimize");
+		mesh_hf.optimize_vertex_cache(&before, &after);
+		mesh_hf.optimize_overdraw();
+		mesh_hf.optimize_vertex_fetch();
+	}
+	xr::log("ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
 
-	sprintf(pc, "WriteObj took %d ms\n", time.measure_duration_ms());
-	OutputDebugStringA(pc);
+	{
+		PROFILE_ZONE("write_obj");
+		mesh_hf.write_obj(OUTPUT_FILENAME);
+	}
 
+	xr::jobs_done();
 	return 0;
 }
\ No newline at end of file
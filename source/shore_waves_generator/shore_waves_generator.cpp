@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <math.h>
 #include <vector>
 #include <algorithm>
 
@@ -126,59 +127,54 @@ void compute_distance_and_normals(Image<u8>& mask, int radius, Image<u8>& distan
 		distance[i] = mask[i] ? radius : 0;
 	}
 
-	xr::TIME_SCOPE ts;
+	PROFILE_ZONE("compute_distance_and_normals");
 
 	const size_t res = mask.resolution();
 	const Vec3i* psk = &sk[0];
 
-	for (size_t y = 0; y < res; ++y)
+	auto process_row = [res, &mask, psk, &sk, &distance, normal_x, normal_y](int y) -> void
 	{
-		auto process_row = [res, &mask, psk, &sk, &distance, normal_x, normal_y, y]() -> void
+		for (size_t x = 0; x < res; ++x)
 		{
-			for (size_t x = 0; x < res; ++x)
-			{
-				if (mask(x, y) == 0) continue;
+			if (mask(x, y) == 0) continue;
 
-				for (int i = 0, n = sk.size(); i < n; ++i)
-				{
-					int xc = x + psk[i].x, yc = y + psk[i].y;
+			for (int i = 0, n = sk.size(); i < n; ++i)
+			{
+				int xc = x + psk[i].x, yc = y + psk[i].y;
 
-					if (!inside(xc, yc)) continue;
+				if (!inside(xc, yc)) continue;
 
-					if (mask(xc, yc) > 0) continue;
+				if (mask(xc, yc) > 0) continue;
 
-					distance(x, y) = psk[i].z;
+				distance(x, y) = psk[i].z;
 
-					if (normal_x && normal_y)
+				if (normal_x && normal_y)
+				{
+					int dx = psk[i].x, dy = psk[i].y, count = 1;
+					for (int found_distance = psk[i].z; i < n && psk[i].z <= found_distance + 1; ++i)
 					{
-						int dx = psk[i].x, dy = psk[i].y, count = 1;
-						for (int found_distance = psk[i].z; i < n && psk[i].z <= found_distance + 1; ++i)
-						{
-							int xc = x + psk[i].x, yc = y + psk[i].y;
-							if (!inside(xc, yc)) continue;
-							if (mask(xc, yc) > 0) continue;
-
-							dx += psk[i].x;
-							dy += psk[i].y;
-							count++;
-						}
-
-						float nx = dx / float(count);
-						float ny = dy / float(count);
-						float len = sqrtf(nx * nx + ny * ny);
-						float mul = 127.0f / len;
-
-						normal_x->at(x, y) = u8_clamp(nx * mul + 128.0f);
-						normal_y->at(x, y) = u8_clamp(ny * mul + 128.0f);
+						int xc = x + psk[i].x, yc = y + psk[i].y;
+						if (!inside(xc, yc)) continue;
+						if (mask(xc, yc) > 0) continue;
+
+						dx += psk[i].x;
+						dy += psk[i].y;
+						count++;
 					}
-					break;
+
+					float nx = dx / float(count);
+					float ny = dy / float(count);
+					float len = sqrtf(nx * nx + ny * ny);
+					float mul = 127.0f / len;
+
+					normal_x->at(x, y) = u8_clamp(nx * mul + 128.0f);
+					normal_y->at(x, y) = u8_clamp(ny * mul + 128.0f);
 				}
+				break;
 			}
-		};
-		xr::jobs_add( process_row, 0, 0);
-	}
-	xr::jobs_wait_all();
-	printf("%d ms\n", ts.measure_duration_ms());
+		}
+	};
+	xr::parallel_for(0, int(res), 1, process_row);
 }
 
 void smooth_coast(Image<u8>& mask, int radius)
@@ -196,7 +192,7 @@ void smooth_coast(Image<u8>& mask, int radius)
 
 void generate_outline(Image<u8>& mask, Image<u8>& outline, u8 shape)
 {
-	xr::TIME_SCOPE ts;
+	PROFILE_ZONE("generate_outline");
 
 	outline.clear();
 
@@ -209,7 +205,6 @@ void generate_outline(Image<u8>& mask, Image<u8>& outline, u8 shape)
 				outline(x, y) = 255;
 		}
 	}
-	printf("Outline: %d ms\n", ts.measure_duration_ms());
 }
 
 void compute_distance_smooth(Image<u8>& mask, int radius, Image<u8>& distance, int found_count /*Image<u8>* normal_x, Image<u8>* normal_y*/)
@@ -231,75 +226,70 @@ void compute_distance_smooth(Image<u8>& mask, int radius, Image<u8>& distance, i
 		distance[i] = mask[i] ? radius : 0;
 	}
 
-	xr::TIME_SCOPE ts;
+	PROFILE_ZONE("compute_distance_smooth");
 
 	const size_t res = mask.resolution();
 	const Vec3i* psk = &sk[0];
 
-	for (size_t y = 0; y < res; ++y)
+	auto process_row = [res, &mask, psk, &sk, &distance, found_count](int y) -> void
 	{
-		auto process_row = [res, &mask, psk, &sk, &distance, found_count, y]() -> void
+		for (size_t x = 0; x < res; ++x)
 		{
-			for (size_t x = 0; x < res; ++x)
-			{
-				if (mask(x, y) == 0) continue;
+			if (mask(x, y) == 0) continue;
 
-				int found = 0;
-				int dist_sum = 0;
+			int found = 0;
+			int dist_sum = 0;
 
-				for (int i = 0, n = sk.size(); i < n; ++i)
-				{
-					int xc = x + psk[i].x, yc = y + psk[i].y;
+			for (int i = 0, n = sk.size(); i < n; ++i)
+			{
+				int xc = x + psk[i].x, yc = y + psk[i].y;
 
-					if (!inside(xc, yc)) continue;
+				if (!inside(xc, yc)) continue;
 
-					if (mask(xc, yc) > 0) continue;
+				if (mask(xc, yc) > 0) continue;
 
-					dist_sum += psk[i].z;
-					found++;
+				dist_sum += psk[i].z;
+				found++;
 
-					if (found == found_count) break;
+				if (found == found_count) break;
 
 
 /*
-					if (normal_x && normal_y)
+				if (normal_x && normal_y)
+				{
+					int dx = psk[i].x, dy = psk[i].y, count = 1;
+					for (int found_distance = psk[i].z; i < n && psk[i].z <= found_distance + 1; ++i)
 					{
-						int dx = psk[i].x, dy = psk[i].y, count = 1;
-						for (int found_distance = psk[i].z; i < n && psk[i].z <= found_distance + 1; ++i)
-						{
-							int xc = x + psk[i].x, yc = y + psk[i].y;
-							if (!inside(xc, yc)) continue;
-							if (mask(xc, yc) > 0) continue;
-
-							dx += psk[i].x;
-							dy += psk[i].y;
-							count++;
-						}
-
-						float nx = dx / float(count);
-						float ny = dy / float(count);
-						float len = sqrtf(nx * nx + ny * ny);
-						float mul = 127.0f / len;
-
-						normal_x->at(x, y) = u8_clamp(nx * mul + 128.0f);
-						normal_y->at(x, y) = u8_clamp(ny * mul + 128.0f);
+						int xc = x + psk[i].x, yc = y + psk[i].y;
+						if (!inside(xc, yc)) continue;
+						if (mask(xc, yc) > 0) continue;
+
+						dx += psk[i].x;
+						dy += psk[i].y;
+						count++;
 					}
-					break;  */
+
+					float nx = dx / float(count);
+					float ny = dy / float(count);
+					float len = sqrtf(nx * nx + ny * ny);
+					float mul = 127.0f / len;
+
+					normal_x->at(x, y) = u8_clamp(nx * mul + 128.0f);
+					normal_y->at(x, y) = u8_clamp(ny * mul + 128.0f);
 				}
-				if(found>0)
-					distance(x, y) = dist_sum / found;
+				break;  */
 			}
-		};
-		xr::jobs_add(process_row, 0, 0);
-	}
-	xr::jobs_wait_all();
-	printf("%d ms\n", ts.measure_duration_ms());
+			if(found>0)
+				distance(x, y) = dist_sum / found;
+		}
+	};
+	xr::parallel_for(0, int(res), 1, process_row);
 }
 
 
 int main()
 {
-	xr::jobs_init(4);
+	xr::jobs_init(0);
 
 	Image<u8> mask(2048), norm_x(2048), norm_y(2048);
 	if (!mask.load("map.raw"))
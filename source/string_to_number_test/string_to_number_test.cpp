@@ -16,36 +16,39 @@ int main()
 		sprintf_s(ps + i * MAX_CHARS_PER_NUMBER, MAX_CHARS_PER_NUMBER, "%3.4f", f);
 	}
 
-	xr::TIME_SCOPE scope;
-
 	float sum = 0.0f;
-	for (int i = 0; i < TEST_SIZE; ++i)
 	{
-		float f = strtof(ps + i * MAX_CHARS_PER_NUMBER, NULL);
-		sum += f;
+		PROFILE_ZONE("strtof");
+		for (int i = 0; i < TEST_SIZE; ++i)
+		{
+			float f = strtof(ps + i * MAX_CHARS_PER_NUMBER, NULL);
+			sum += f;
+		}
 	}
-	printf("strtof: %d ms (%0.2f)\n", scope.measure_duration_ms(), sum);
-
-	scope.reset();
+	printf("strtof: %0.2f\n", sum);
 
 	sum = 0.0f;
-	for (int i = 0; i < TEST_SIZE; ++i)
 	{
-		float f = atof(ps + i * MAX_CHARS_PER_NUMBER);
-		sum += f;
+		PROFILE_ZONE("atof");
+		for (int i = 0; i < TEST_SIZE; ++i)
+		{
+			float f = atof(ps + i * MAX_CHARS_PER_NUMBER);
+			sum += f;
+		}
 	}
-	printf("atof: %d ms (%0.2f)\n", scope.measure_duration_ms(), sum);
-
-	scope.reset();
+	printf("atof: %0.2f\n", sum);
 
 	sum = 0.0f;
-	for (int i = 0; i < TEST_SIZE; ++i)
 	{
-		float f;
-		std::from_chars(ps + i * MAX_CHARS_PER_NUMBER, ps + (i+1) * MAX_CHARS_PER_NUMBER, f);
-		sum += f;
+		PROFILE_ZONE("from_chars");
+		for (int i = 0; i < TEST_SIZE; ++i)
+		{
+			float f;
+			std::from_chars(ps + i * MAX_CHARS_PER_NUMBER, ps + (i+1) * MAX_CHARS_PER_NUMBER, f);
+			sum += f;
+		}
 	}
-	printf("from_chars: %d ms (%0.2f)\n", scope.measure_duration_ms(), sum);
+	printf("from_chars: %0.2f\n", sum);
 
 	return 0;
 }
\ No newline at end of file
@@ -1,11 +1,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <xr/file.h>
+
 #define RES			2304
 #define INPUT_FILE	"blend.raw"
 
-typedef unsigned char u8;
-
 template< class T > void swap(T& a, T& b) { T temp = a; a = b; b = temp; }
 template< class T > T max(T a, T b) { return a > b ? a : b; }
 
@@ -59,16 +59,17 @@ int main()
 		fwrite(dst, 1, RES, out);
 	};
 
-	FILE* fp = fopen(INPUT_FILE, "rb");
+	// the next rows stream in while the current ones are allocated and copied
+	xr::FILE* fp = xr::FILE::open(INPUT_FILE, xr::FILE::READ | xr::FILE::ASYNC, RES * 8 * 64);
 	if (!fp) return 1;
 
 	u8** src = new u8*[RES];
 	for (int y = 0; y < RES; ++y)
 	{
 		src[y] = new u8[RES * 8];
-		fread(src[y], 1, RES * 8, fp);
+		fp->read(src[y], RES * 8);
 	}
-	fclose(fp);
+	delete fp;
 
 	auto fetch_terrain = [src](int x, int y, int channel) -> u8
 	{
@@ -93,14 +94,14 @@ int main()
 
 	filter_terrain_blend<u8, 8>(0, 0, RES-1, RES-1, fetch_terrain, store_terrain);
 
-	fp = fopen("filtered.raw", "wb");
+	fp = xr::FILE::open("filtered.raw", xr::FILE::WRITE | xr::FILE::TRUNC | xr::FILE::ASYNC, RES * 8 * 64);
 	if (!fp) return 1;
 
 	for (int y = 0; y < RES; ++y)
 	{
-		fwrite(src[y], 1, RES * 8, fp);
+		fp->write(src[y], RES * 8);
 	}
-	fclose(fp);
+	delete fp;
 	
 	return 0;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <xr/core.h>
 
 struct HEIGHTFIELD
 {
@@ -106,7 +107,7 @@ struct HEIGHTFIELD
 		const float Ks = 0.003f;
 		const float Kss = 0.2f;
 
-		unsigned int R = unsigned int(m_res-1);
+		unsigned int R = (unsigned int)(m_res-1);
 		for (int count = 0; x+1 < R && y+1 < R && x > 0 && y > 0 && count < 20; ++count )
 		{
 			float h10 = at(x - 1, y);
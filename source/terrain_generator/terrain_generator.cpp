@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <xr/core.h>
 #include <xr/heightfield_simplifier.h>
+#include <xr/mesh_codec.h>
 #include "heightfield.h"
 
 #define RESOLUTION 512
@@ -77,7 +78,11 @@ int main()
 
 	xr::MESH mesh;
 	xr::heightfield_simplify(hf.m_hf, nullptr, RESOLUTION, RESOLUTION, 256.0f / RESOLUTION, -10000.0f, 128, 0.1f, mesh);
+	mesh.optimize_vertex_cache();
+	mesh.optimize_overdraw();
+	mesh.optimize_vertex_fetch();
 	mesh.write_obj("terrain.obj");
+	xr::write_packed_mesh(mesh, "terrain.xmpk");
 
 	return 0;
 }
\ No newline at end of file
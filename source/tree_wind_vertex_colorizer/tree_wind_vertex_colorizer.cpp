@@ -3,6 +3,7 @@
 #include <windows.h>
 
 #include <xr/mesh.h>
+#include <xr/time.h>
 
 #include <unordered_map>
 #include <vector>
@@ -69,7 +70,7 @@ int main()
 	VOLUME<int> voxels(128, 128, 128);
 	float3		mesh_scale, mesh_pivot;
 
-	if (mesh.read_obj("TreeTrunk.obj"))
+	if (mesh.read_cached("TreeTrunk.obj"))
 	{
 #if 1// skeletonize mesh
 		xr::MESH skeleton;
@@ -80,9 +81,10 @@ int main()
 #endif
 	
 #if 0	// voxelize mesh
-		clock_t t0 = clock();
-		mesh_to_voxel(xma, voxels, mesh_scale, mesh_pivot);
-		printf("mesh_to_voxel: %d ms\n", (clock() - t0) * 1000 / CLOCKS_PER_SEC);
+		{
+			PROFILE_ZONE("mesh_to_voxel");
+			mesh_to_voxel(xma, voxels, mesh_scale, mesh_pivot);
+		}
 
 	#if 0 // meshify voxels
 			xr::MESH voxel;
@@ -1,7 +1,9 @@
 #include <xr/core.h>
 #include <stdarg.h>
 #include <stdio.h>
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 namespace xr
 {
@@ -20,10 +22,12 @@ namespace xr
 		va_list args;
 		va_start(args, format);
 		char buf[2048];
-		vsprintf_s(buf, format, args);
+		vsnprintf(buf, sizeof(buf), format, args);
 		va_end(args);
 
+#ifdef _WIN32
 		OutputDebugStringA(buf);
-		printf(buf);
+#endif
+		printf("%s", buf);
 	}
 }
\ No newline at end of file
@@ -2,17 +2,29 @@
 
 #include <memory.h>
 
+#ifdef _MSC_VER
 #define DEBUG_BREAK() __debugbreak()
+#else
+#define DEBUG_BREAK() __builtin_trap()
+#endif
 
 #define ASSERT(x) do{if(!(x)) DEBUG_BREAK();}while(0)
 
 typedef unsigned char		u8;
 typedef unsigned short		u16;
+#ifdef _MSC_VER
 typedef unsigned long		u32;
+#else
+typedef unsigned int		u32;	// long is 64 bit on LP64
+#endif
 typedef unsigned long long	u64;
 typedef signed char			i8;
 typedef signed short		i16;
+#ifdef _MSC_VER
 typedef signed long			i32;
+#else
+typedef signed int			i32;
+#endif
 typedef signed long long	i64;
 
 namespace xr
@@ -51,8 +63,8 @@ namespace xr
 	inline u32 hash(u8 x) { return x; }
 	inline u32 hash(u16 x) { return x; }
 	inline u32 hash(u32 x) { return x; }
-	inline u32 hash(float x) { return *((u32*)&x); }
-	inline u32 hash(void* x) { return sizeof(x) == 4 ? u32(x) : (u32(x) ^ (u64(x) >> 32U)); }
+	inline u32 hash(float x) { u32 u; memcpy(&u, &x, sizeof(u)); return u; }
+	inline u32 hash(void* x) { return u32(size_t(x)) ^ u32(u64(size_t(x)) >> 32U); }
 	u32 hash_string(const char* str);
 
 	void asset_error(const char* fmt, ...);
@@ -1,60 +1,254 @@
 #include <xr/file.h>
+#include <xr/threads.h>
+#include <xr/format.h>
 
 #include <stdio.h>
 #include <stdarg.h>
+#ifdef _WIN32
 #include <Windows.h>
-#include <math.h>
-
-#define FILE_BUFFER_SIZE 4096
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <errno.h>
+#endif
+#include <string.h>
+#include <atomic>
+
+#define FILE_BUFFER_SIZE		(64 * 1024)
+#define FILE_ASYNC_BUFFER_SIZE	(1024 * 1024)
+#define FILE_ASYNC_DEPTH		2
 
 namespace xr
 {
-	struct FILE_WIN32 : public FILE
+	// thin layer over the native file api, FILE_OS does the buffering on top of it
+#ifdef _WIN32
+	typedef HANDLE FILE_HANDLE;
+	#define INVALID_FILE_HANDLE INVALID_HANDLE_VALUE
+
+	static FILE_HANDLE native_open(const char* file, u32 flags)
 	{
-		HANDLE	m_fp;
-		u8		m_buffer[FILE_BUFFER_SIZE];
-		u32		m_pos, m_buffer_size;
-		bool	m_read_once;
+		DWORD access = 0;
+		if (flags & FILE::READ) access |= GENERIC_READ;
+		if (flags & FILE::WRITE) access |= GENERIC_WRITE;
+
+		DWORD share_mode = 0;
+		if ((flags & FILE::READ) != 0 && (flags & FILE::WRITE) == 0) share_mode |= FILE_SHARE_READ;
 
-		FILE_WIN32(const char* file, u32 flags) : m_pos(0), m_buffer_size(0)
+		DWORD creation = 0;
+		switch (flags)
 		{
-			DWORD access = 0;
-			if (flags & READ) access |= GENERIC_READ;
-			if (flags & WRITE) access |= GENERIC_WRITE;
+			case FILE::WRITE: creation |= OPEN_ALWAYS; break;
+			case FILE::READ: creation |= OPEN_EXISTING; break;
+			case FILE::WRITE | FILE::READ: creation |= OPEN_ALWAYS; break;
+			case FILE::WRITE | FILE::TRUNC: creation |= CREATE_ALWAYS; break;
+			case FILE::WRITE | FILE::READ | FILE::TRUNC: creation |= CREATE_ALWAYS; break;
+		}
+		DWORD f = FILE_ATTRIBUTE_NORMAL;
+
+		return ::CreateFileA(file, access, share_mode, NULL, creation, f, NULL);
+	}
+	static void native_close(FILE_HANDLE fp)
+	{
+		CloseHandle(fp);
+	}
+	static u32 native_read(FILE_HANDLE fp, void* ptr, u32 size)
+	{
+		DWORD read = 0;
+		if (!ReadFile(fp, ptr, size, &read, NULL))
+			return 0;
+		return read;
+	}
+	static bool native_write(FILE_HANDLE fp, const void* ptr, u32 size, u32& written)
+	{
+		DWORD w = 0;
+		const bool ok = WriteFile(fp, ptr, size, &w, NULL) != 0;
+		written = w;
+		return ok;
+	}
+	static bool native_writev(FILE_HANDLE fp, const void* ptr1, u32 size1, const void* ptr2, u32 size2)
+	{
+		// WriteFileGather needs unbuffered page aligned io, two writes it is
+		u32 written;
+		return native_write(fp, ptr1, size1, written) && native_write(fp, ptr2, size2, written);
+	}
+	static u64 native_size(FILE_HANDLE fp)
+	{
+		DWORD high;
+		DWORD low = GetFileSize(fp, &high);
+		return low | (u64(high) << 32);
+	}
+	static u64 native_last_write_time(FILE_HANDLE fp)
+	{
+		FILETIME ft;
+		GetFileTime(fp, NULL, NULL, &ft);
+		return ft.dwLowDateTime | (u64(ft.dwHighDateTime) << 32);
+	}
+	static const u8* native_map(FILE_HANDLE fp, u64 size, bool copy_on_write)
+	{
+		HANDLE mapping = CreateFileMappingA(fp, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+			return nullptr;
+
+		// the view keeps the mapping object alive
+		void* ptr = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		return (const u8*)ptr;
+	}
+	static void native_unmap(const u8* ptr, u64)
+	{
+		UnmapViewOfFile(ptr);
+	}
+#else
+	typedef int FILE_HANDLE;
+	#define INVALID_FILE_HANDLE -1
+
+	static FILE_HANDLE native_open(const char* file, u32 flags)
+	{
+		int mode = 0;
+		if ((flags & FILE::READ) && (flags & FILE::WRITE)) mode = O_RDWR;
+		else if (flags & FILE::WRITE) mode = O_WRONLY;
+		else mode = O_RDONLY;
 
-			DWORD share_mode = 0;
-			if ((flags & READ) != 0 && (flags & WRITE) == 0) share_mode |= FILE_SHARE_READ;
+		if (flags & FILE::WRITE) mode |= O_CREAT;
+		if (flags & FILE::TRUNC) mode |= O_TRUNC;
 
-			DWORD creation = 0;
-			switch (flags)
+		return ::open(file, mode | O_CLOEXEC, 0644);
+	}
+	static void native_close(FILE_HANDLE fp)
+	{
+		::close(fp);
+	}
+	static u32 native_read(FILE_HANDLE fp, void* ptr, u32 size)
+	{
+		for (;;)
+		{
+			ssize_t r = ::read(fp, ptr, size);
+			if (r >= 0)
+				return u32(r);
+			if (errno != EINTR)
+				return 0;
+		}
+	}
+	static bool native_write(FILE_HANDLE fp, const void* ptr, u32 size, u32& written)
+	{
+		written = 0;
+		while (written < size)
+		{
+			ssize_t w = ::write(fp, (const u8*)ptr + written, size - written);
+			if (w < 0)
 			{
-				case WRITE: creation |= OPEN_ALWAYS; break;
-				case READ: creation |= OPEN_EXISTING; break;
-				case WRITE | READ: creation |= OPEN_ALWAYS; break;
-				case WRITE | TRUNC: creation |= CREATE_ALWAYS; break;
-				case WRITE | READ | TRUNC: creation |= CREATE_ALWAYS; break;
+				if (errno == EINTR)
+					continue;
+				return false;
 			}
-			DWORD f = FILE_ATTRIBUTE_NORMAL;
+			written += u32(w);
+		}
+		return true;
+	}
+	static bool native_writev(FILE_HANDLE fp, const void* ptr1, u32 size1, const void* ptr2, u32 size2)
+	{
+		iovec iov[2];
+		iov[0].iov_base = (void*)ptr1;
+		iov[0].iov_len = size1;
+		iov[1].iov_base = (void*)ptr2;
+		iov[1].iov_len = size2;
+
+		iovec* v = iov;
+		int count = 2;
+		while (count)
+		{
+			ssize_t w = ::writev(fp, v, count);
+			if (w < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			// skip what was written, a short write may end in the middle of either buffer
+			while (count && size_t(w) >= v->iov_len)
+			{
+				w -= v->iov_len;
+				++v;
+				--count;
+			}
+			if (count)
+			{
+				v->iov_base = (u8*)v->iov_base + w;
+				v->iov_len -= w;
+			}
+		}
+		return true;
+	}
+	static u64 native_size(FILE_HANDLE fp)
+	{
+		struct stat st;
+		if (fstat(fp, &st))
+			return 0;
+		return u64(st.st_size);
+	}
+	static u64 native_last_write_time(FILE_HANDLE fp)
+	{
+		struct stat st;
+		if (fstat(fp, &st))
+			return 0;
 
-			m_fp = ::CreateFileA(file, access, share_mode, NULL, creation, f, NULL);
+		// same units as the win32 FILETIME: 100ns intervals since 1601
+		return u64(st.st_mtim.tv_sec) * 10000000ULL + u64(st.st_mtim.tv_nsec) / 100 + 116444736000000000ULL;
+	}
+	static const u8* native_map(FILE_HANDLE fp, u64 size, bool copy_on_write)
+	{
+		void* ptr = mmap(nullptr, size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fp, 0);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+
+		madvise(ptr, size, MADV_SEQUENTIAL);
+		return (const u8*)ptr;
+	}
+	static void native_unmap(const u8* ptr, u64 size)
+	{
+		munmap((void*)ptr, size);
+	}
+#endif
+
+	struct FILE_OS : public FILE
+	{
+		FILE_HANDLE	m_fp;
+		u8*			m_buffer;
+		u32			m_capacity;
+		u32			m_pos, m_buffer_size;
+		bool		m_read_once;
+
+		FILE_OS(const char* file, u32 flags, u32 buffer_size) : m_pos(0), m_buffer_size(0)
+		{
+			m_fp = native_open(file, flags);
+			m_capacity = buffer_size;
+			m_buffer = new u8[buffer_size];
 
 			m_read_once = false;
 		}
 
 		bool initialized()
 		{
-			return m_fp != INVALID_HANDLE_VALUE;
+			return m_fp != INVALID_FILE_HANDLE;
 		}
 
-		virtual ~FILE_WIN32()
+		virtual ~FILE_OS()
 		{
 			if (m_pos)
-			{
-				u32 written = 0;
-				WriteFile(m_fp, m_buffer, m_pos, &written, NULL);
-			}
-			if( m_fp != INVALID_HANDLE_VALUE )
-				CloseHandle(m_fp);
+				flush();
+			if( m_fp != INVALID_FILE_HANDLE )
+				native_close(m_fp);
+			delete[] m_buffer;
+		}
+		bool flush()
+		{
+			u32 written = 0;
+			const bool ok = native_write(m_fp, m_buffer, m_pos, written);
+			m_pos = 0;
+			return ok;
 		}
 		virtual u32 write(const void* ptr, u32 size)
 		{
@@ -62,7 +256,7 @@ namespace xr
 			{
 				return 0;
 			}
-			if (m_pos + size <= FILE_BUFFER_SIZE)
+			if (m_pos + size <= m_capacity)
 			{
 				if (size == 1)
 				{
@@ -74,20 +268,31 @@ namespace xr
 				return size;
 			}
 
-			u32 written = 0;
+			// the buffered bytes and a large block go out in one vectored write
+			if (size >= m_capacity)
+			{
+				const bool ok = native_writev(m_fp, m_buffer, m_pos, ptr, size);
+				m_pos = 0;
+				return ok ? size : 0;
+			}
 
-			if (!WriteFile(m_fp, m_buffer, m_pos, &written, NULL))
+			if (!flush())
 				return 0;
 
-			m_pos = 0;
-
-			if (size >= FILE_BUFFER_SIZE)
-			{
-				WriteFile(m_fp, ptr, size, &written, NULL);
-				return written;
-			}
 			return write(ptr, size);
 		}
+		virtual u8* reserve(u32 size)
+		{
+			if (size > m_capacity)
+				return nullptr;
+			if (m_pos + size > m_capacity)
+				flush();
+			return m_buffer + m_pos;
+		}
+		virtual void commit(u32 size)
+		{
+			m_pos += size;
+		}
 		virtual u32 read(void* ptr, u32 size)
 		{
 			m_read_once = true;
@@ -97,12 +302,11 @@ namespace xr
 			{
 				if (m_pos == m_buffer_size)
 				{
-					ReadFile(m_fp, m_buffer, FILE_BUFFER_SIZE, &m_buffer_size, NULL);
+					m_buffer_size = native_read(m_fp, m_buffer, m_capacity);
 					if (!m_buffer_size)
 						return read_size;
 					m_pos = 0;
 				}
-
 				int sz = xr::Min(m_buffer_size - m_pos, size - read_size);
 				memcpy(ptr, m_buffer + m_pos, sz);
 				ptr = (u8*)ptr + sz;
@@ -134,19 +338,382 @@ namespace xr
 		}
 		virtual bool eof()
 		{
-			return m_read_once && m_pos == m_buffer_size && m_buffer_size < FILE_BUFFER_SIZE;
+			return m_read_once && m_pos == m_buffer_size && m_buffer_size < m_capacity;
+		}
+		virtual u64 size()
+		{
+			return native_size(m_fp);
+		}
+		virtual u64 get_last_write_time()
+		{
+			return native_last_write_time(m_fp);
+		}
+	};
+
+	static u32 native_read_full(FILE_HANDLE fp, u8* ptr, u32 size)
+	{
+		u32 read_size = 0;
+		while (read_size < size)
+		{
+			u32 r = native_read(fp, ptr + read_size, size - read_size);
+			if (!r)
+				break;
+			read_size += r;
+		}
+		return read_size;
+	}
+
+	// streams through a ring of large buffers. a background thread reads the next buffers ahead, or writes
+	// the filled ones back, while the caller works on its current buffer. m_produced and m_consumed count
+	// the buffers handed over in each direction: the io thread produces when reading and consumes when writing
+	struct FILE_ASYNC : public FILE
+	{
+		FILE_HANDLE			m_fp;
+		bool				m_write;
+		u32					m_buffer_size;
+		u32					m_depth;
+		u8*					m_buffers;		// m_depth buffers of m_buffer_size bytes
+		u32*				m_sizes;		// valid bytes in each buffer
+		u64					m_produced;
+		u64					m_consumed;
+		bool				m_end;			// the io thread reached the end of the file
+		bool				m_quit;
+		std::atomic<bool>	m_error;
+		bool				m_has_buffer;	// the caller owns the current buffer
+		u32					m_pos;			// caller position in the current buffer
+		CRITICAL_SECTION	m_cs;
+		EVENT				m_io_event;
+		EVENT				m_caller_event;
+		THREAD				m_thread;
+
+		FILE_ASYNC(const char* file, u32 flags, u32 buffer_size, u32 depth) :
+			m_write((flags & WRITE) != 0), m_buffer_size(buffer_size), m_depth(depth),
+			m_produced(0), m_consumed(0), m_end(false), m_quit(false), m_error(false), m_has_buffer(false), m_pos(0), m_thread(nullptr)
+		{
+			m_buffers = new u8[u64(buffer_size) * depth];
+			m_sizes = new u32[depth];
+
+			m_fp = native_open(file, flags & (READ | WRITE | TRUNC));
+			if (m_fp != INVALID_FILE_HANDLE)
+				m_thread = thread_create(io_thread, this, 0);
+		}
+
+		bool initialized()
+		{
+			return m_thread != nullptr;
+		}
+
+		virtual ~FILE_ASYNC()
+		{
+			if (m_thread)
+			{
+				if (m_write && m_has_buffer && m_pos)
+					submit_write();
+				{
+					CS_SCOPE(m_cs);
+					m_quit = true;
+				}
+				m_io_event.signal();
+				thread_join(m_thread);
+
+				if (m_error)
+					log("ERROR: async file write failed!\n");
+			}
+			if (m_fp != INVALID_FILE_HANDLE)
+				native_close(m_fp);
+
+			delete[] m_sizes;
+			delete[] m_buffers;
+		}
+
+		u8* buffer(u64 index)
+		{
+			return m_buffers + (index % m_depth) * m_buffer_size;
+		}
+
+		static void io_thread(void* param)
+		{
+			((FILE_ASYNC*)param)->io_loop();
+		}
+
+		void io_loop()
+		{
+			for (;;)
+			{
+				u64 index;
+				{
+					CS_SCOPE(m_cs);
+					const bool work = m_write ? m_consumed < m_produced : !m_end && m_produced - m_consumed < m_depth;
+					if (!work)
+					{
+						// a writer finishes the pending buffers first
+						if (m_quit)
+							return;
+						index = ~0ULL;
+					}
+					else
+						index = m_write ? m_consumed : m_produced;
+				}
+				if (index == ~0ULL)
+				{
+					m_io_event.wait();
+					continue;
+				}
+
+				if (m_write)
+				{
+					u32 written = 0;
+					if (!native_write(m_fp, buffer(index), m_sizes[index % m_depth], written))
+						m_error = true;
+
+					CS_SCOPE(m_cs);
+					m_consumed++;
+				}
+				else
+				{
+					const u32 size = native_read_full(m_fp, buffer(index), m_buffer_size);
+
+					CS_SCOPE(m_cs);
+					m_sizes[index % m_depth] = size;
+					if (size)
+						m_produced++;
+					if (size < m_buffer_size)
+						m_end = true;
+				}
+				m_caller_event.signal();
+			}
+		}
+
+		// read side: makes sure the caller's buffer has unread bytes, false at the end of the file
+		bool acquire_read()
+		{
+			if (m_has_buffer)
+			{
+				if (m_pos < m_sizes[m_consumed % m_depth])
+					return true;
+				{
+					CS_SCOPE(m_cs);
+					m_consumed++;
+				}
+				m_io_event.signal();
+				m_has_buffer = false;
+			}
+			for (;;)
+			{
+				{
+					CS_SCOPE(m_cs);
+					if (m_consumed < m_produced)
+						break;
+					if (m_end)
+						return false;
+				}
+				m_caller_event.wait();
+			}
+			m_has_buffer = true;
+			m_pos = 0;
+			return true;
+		}
+
+		// write side: waits for a free buffer in the ring
+		void acquire_write()
+		{
+			for (;;)
+			{
+				{
+					CS_SCOPE(m_cs);
+					if (m_produced - m_consumed < m_depth)
+						break;
+				}
+				m_caller_event.wait();
+			}
+			m_has_buffer = true;
+			m_pos = 0;
+		}
+
+		void submit_write()
+		{
+			{
+				CS_SCOPE(m_cs);
+				m_sizes[m_produced % m_depth] = m_pos;
+				m_produced++;
+			}
+			m_io_event.signal();
+			m_has_buffer = false;
+		}
+
+		virtual u32 write(const void* ptr, u32 size)
+		{
+			if (!m_write)
+				return 0;
+
+			const u8* src = (const u8*)ptr;
+			for (u32 left = size; left > 0; )
+			{
+				if (!m_has_buffer)
+					acquire_write();
+
+				u32 sz = Min(left, m_buffer_size - m_pos);
+				memcpy(buffer(m_produced) + m_pos, src, sz);
+				m_pos += sz;
+				src += sz;
+				left -= sz;
+
+				if (m_pos == m_buffer_size)
+					submit_write();
+			}
+			return m_error ? 0 : size;
+		}
+		virtual u8* reserve(u32 size)
+		{
+			if (!m_write || size > m_buffer_size)
+				return nullptr;
+
+			// hand over the current buffer early rather than splitting the reserved range
+			if (m_has_buffer && m_pos + size > m_buffer_size)
+				submit_write();
+			if (!m_has_buffer)
+				acquire_write();
+			return buffer(m_produced) + m_pos;
+		}
+		virtual void commit(u32 size)
+		{
+			m_pos += size;
+			if (m_pos == m_buffer_size)
+				submit_write();
+		}
+		virtual u32 read(void* ptr, u32 size)
+		{
+			if (m_write)
+				return 0;
+
+			u32 read_size = 0;
+			while (read_size < size && acquire_read())
+			{
+				u32 sz = Min(m_sizes[m_consumed % m_depth] - m_pos, size - read_size);
+				memcpy((u8*)ptr + read_size, buffer(m_consumed) + m_pos, sz);
+				m_pos += sz;
+				read_size += sz;
+			}
+			return read_size;
+		}
+		virtual u32	read_line(char* buffer_ptr, u32 max_len)
+		{
+			for (u32 i = 0; i + 1 < max_len; )
+			{
+				if (m_write || !acquire_read()) {
+					buffer_ptr[i] = 0;
+					return i;
+				}
+				char ch = (char)buffer(m_consumed)[m_pos++];
+				bool NL = ch == '\n' || ch == '\r';
+				if (!NL) {
+					buffer_ptr[i++] = ch;
+				}
+				else if (i) {
+					buffer_ptr[i] = 0;
+					return i;
+				}
+			}
+			buffer_ptr[max_len - 1] = 0;
+			return max_len;
+		}
+		virtual bool eof()
+		{
+			return m_write ? false : !acquire_read();
+		}
+		virtual u64 size()
+		{
+			return native_size(m_fp);
+		}
+		virtual u64 get_last_write_time()
+		{
+			return native_last_write_time(m_fp);
+		}
+	};
+
+	// view of a whole mapped file, read only unless COPY_ON_WRITE; read and read_line copy out of the mapping
+	struct FILE_MMAP : public FILE
+	{
+		FILE_HANDLE	m_fp;
+		const u8*	m_data;
+		u64			m_size;
+		u64			m_pos;
+
+		FILE_MMAP(const char* file, u32 flags) : m_data(nullptr), m_size(0), m_pos(0)
+		{
+			m_fp = native_open(file, READ);
+			if (m_fp == INVALID_FILE_HANDLE)
+				return;
+
+			// empty files can't be mapped, they are valid with a null data()
+			m_size = native_size(m_fp);
+			if (m_size)
+			{
+				m_data = native_map(m_fp, m_size, (flags & COPY_ON_WRITE) != 0);
+				if (!m_data)
+				{
+					native_close(m_fp);
+					m_fp = INVALID_FILE_HANDLE;
+				}
+			}
+		}
+
+		bool initialized()
+		{
+			return m_fp != INVALID_FILE_HANDLE;
+		}
+
+		virtual ~FILE_MMAP()
+		{
+			if (m_data)
+				native_unmap(m_data, m_size);
+			if (m_fp != INVALID_FILE_HANDLE)
+				native_close(m_fp);
+		}
+		virtual u32 write(const void*, u32)
+		{
+			return 0;
+		}
+		virtual u32 read(void* ptr, u32 size)
+		{
+			u32 sz = u32(Min(u64(size), m_size - m_pos));
+			memcpy(ptr, m_data + m_pos, sz);
+			m_pos += sz;
+			return sz;
+		}
+		virtual u32	read_line(char* buffer, u32 max_len)
+		{
+			FILE_LINES lines(m_data + m_pos, m_size - m_pos);
+
+			STRING_VIEW line;
+			if (!lines.next(line))
+			{
+				m_pos = m_size;
+				buffer[0] = 0;
+				return 0;
+			}
+			m_pos = (const u8*)lines.position() - m_data;
+
+			u32 len = Min(line.len, max_len - 1);
+			memcpy(buffer, line.ptr, len);
+			buffer[len] = 0;
+			return len;
+		}
+		virtual bool eof()
+		{
+			return m_pos == m_size;
 		}
 		virtual u64 size()
 		{
-			u32 high;
-			u32 low = GetFileSize(m_fp, &high);
-			return low | (u64(high) << 32);
+			return m_size;
 		}
 		virtual u64 get_last_write_time()
 		{
-			FILETIME ft;
-			GetFileTime(m_fp, NULL, NULL, &ft);
-			return ft.dwLowDateTime | (u64(ft.dwHighDateTime) << 32);
+			return native_last_write_time(m_fp);
+		}
+		virtual const u8* data()
+		{
+			return m_data;
 		}
 	};
 
@@ -156,13 +723,17 @@ namespace xr
 		{
 			char buf[1025];
 			const char* p = (const char*)ptr;
-			for (; size > 0; size -= 1024, p += 1024)
+			for (u32 left = size; left > 0; )
 			{
-				int len = Min(size, (u32)1024);
-				strncpy_s(buf, p, len);
+				u32 len = Min(left, (u32)1024);
+				memcpy(buf, p, len);
 				buf[len] = 0;
 				printf("%s", buf);
+#ifdef _WIN32
 				OutputDebugStringA(buf);
+#endif
+				p += len;
+				left -= len;
 			}
 			return size;
 		}
@@ -188,80 +759,50 @@ namespace xr
 		}
 	};
 
-	FILE* FILE::open(const char* file, u32 flags)
+	FILE* FILE::open(const char* file, u32 flags, u32 buffer_size, u32 depth)
 	{
-		FILE_WIN32* ptr = new FILE_WIN32(file, flags);
-		if (ptr->initialized())
-			return ptr;
-
-		delete ptr;
-		return nullptr;
-	}
-
-	FILE* FILE::std_out()
-	{
-		static FILE_STDOUT fso;
-		return &fso;
-	}
-
-	static int print_int(char* buf, int value)
-	{
-		char d[32];
-		int	count = 0;
-
-		char* ptr = buf;
-
-		if (value < 0)
+		if (flags & MMAP)
 		{
-			*ptr++ = '-';
-			value = -value;
-		}
+			if ((flags & ~COPY_ON_WRITE) != (READ | MMAP))
+				return nullptr;
 
-		do
-		{
-			int div10 = value / 10;
-			d[count++] = (value - div10 * 10) + '0';
-			value = div10;
-		} while (value > 0);
+			FILE_MMAP* ptr = new FILE_MMAP(file, flags);
+			if (ptr->initialized())
+				return ptr;
 
-		while (count)
-		{
-			*ptr++ = d[--count];
+			delete ptr;
+			return nullptr;
 		}
-		return ptr - buf;
-	}
 
-	static int print_float(char* buf, float value, int precision)
-	{
-		int	count = 0, ret = 0;
+		if (flags & ASYNC)
+		{
+			const u32 rw = flags & (READ | WRITE);
+			if (rw != READ && rw != WRITE)
+				return nullptr;
 
-		char* ptr = buf;
+			FILE_ASYNC* ptr = new FILE_ASYNC(file, flags, buffer_size ? buffer_size : FILE_ASYNC_BUFFER_SIZE, Max<u32>(depth ? depth : FILE_ASYNC_DEPTH, 2));
+			if (ptr->initialized())
+				return ptr;
 
-		if (value < 0)
-		{
-			*ptr++ = '-';
-			value = -value;
+			delete ptr;
+			return nullptr;
 		}
 
-		float intp = floorf(value);
-		value -= intp;
+		FILE_OS* ptr = new FILE_OS(file, flags, buffer_size ? buffer_size : FILE_BUFFER_SIZE);
+		if (ptr->initialized())
+			return ptr;
 
-		ptr += print_int(ptr, int(intp));
+		delete ptr;
+		return nullptr;
+	}
 
-		if (precision)
-		{
-			*ptr++ = '.';
-			for (int i = 0; i < precision; ++i)
-			{
-				value *= 10.0f;
-				float iv = floorf(value);
-				*ptr++ = '0' + int(iv);
-				value -= iv;
-			}
-		}
-		return ptr - buf;
+	FILE* FILE::std_out()
+	{
+		static FILE_STDOUT fso;
+		return &fso;
 	}
 
+	// supports %d, %s and %f with an optional [0][width][.precision] like printf, %f without a precision prints 6 digits
 	void FILE::printf(const char* format, ...)
 	{
 		va_list args;
@@ -269,7 +810,7 @@ namespace xr
 
 		const char* str_begin = format;
 
-		char buf[32];
+		char buf[FORMAT_FLOAT_MAX];
 
 		for (;;)
 		{
@@ -284,7 +825,18 @@ namespace xr
 			{
 				write(str_begin, format - str_begin - 1);
 
-				int precision = 2;
+				const bool zero_pad = *format == '0';
+				int width = 0;
+				while (*format >= '0' && *format <= '9')
+					width = width * 10 + (*format++ - '0');
+
+				int precision = 6;
+				if (*format == '.')
+				{
+					precision = 0;
+					for (++format; *format >= '0' && *format <= '9'; ++format)
+						precision = precision * 10 + (*format - '0');
+				}
 
 				char cn = *format++;
 				switch (cn)
@@ -293,10 +845,28 @@ namespace xr
 					write("%", 1);
 					break;
 				case 'd':
+				case 'f':
 				{
-					int value = va_arg(args, int);
-					int len = print_int(buf, value);
-					write(buf, len);
+					// numbers are formatted straight into the write buffer unless they need padding
+					char* out = width ? nullptr : (char*)reserve(sizeof(buf));
+					char* dst = out ? out : buf;
+
+					int len = (cn == 'd') ? format_int(dst, va_arg(args, int)) : format_float(dst, float(va_arg(args, double)), precision);
+					if (out)
+					{
+						commit(len);
+						break;
+					}
+					const char* digits = buf;
+					if (zero_pad && *digits == '-')
+					{
+						write(digits++, 1);
+						len--;
+						width--;
+					}
+					for (int i = len; i < width; ++i)
+						write(zero_pad ? "0" : " ", 1);
+					write(digits, len);
 					break;
 				}
 				case 's':
@@ -305,19 +875,6 @@ namespace xr
 					write(str, strlen(str));
 					break;
 				}
-				case '.':
-					precision = *format++ - '0';
-					if (*format++ != 'f')
-					{
-						//error
-					}
-				case 'f':
-				{
-					float value = va_arg(args, double);
-					int len = print_float(buf, value, precision);
-					write(buf, len);
-					break;
-				}
 				}
 				str_begin = format;
 				break;
@@ -325,4 +882,4 @@ namespace xr
 			}
 		}
 	}
-}
\ No newline at end of file
+}
@@ -11,6 +11,9 @@ namespace xr
 			READ	= 1 << 0,
 			WRITE	= 1 << 1,
 			TRUNC	= 1 << 2,
+			MMAP	= 1 << 3,	// with READ only: maps the whole file, its contents are accessible through data()
+			ASYNC	= 1 << 4,	// with either READ or WRITE: a background thread reads ahead or writes back whole buffers
+			COPY_ON_WRITE	= 1 << 5,	// with MMAP: data() may be written to, touched pages become private copies that never reach the file
 		};
 
 		virtual ~FILE() {}
@@ -21,10 +24,64 @@ namespace xr
 		virtual bool	eof() = 0;
 		virtual u64		size() = 0;
 		virtual u64		get_last_write_time() = 0;
+		virtual const u8*	data() { return nullptr; }	// size() bytes of a file opened with MMAP, null otherwise
+
+		// in place writing: reserve returns room for 'size' bytes in the write buffer, commit appends the
+		// first 'size' of them to the file. null when the file isn't buffered for writing or 'size' exceeds its buffer
+		virtual u8*		reserve(u32) { return nullptr; }
+		virtual void	commit(u32) {}
 
 		void			printf(const char* format, ...);
 
-		static FILE*	open(const char* file, u32 flags);
+		// buffer_size and depth (buffers in flight, ASYNC only) are left at their defaults when 0
+		static FILE*	open(const char* file, u32 flags, u32 buffer_size = 0, u32 depth = 0);
 		static FILE*	std_out();
 	};
+
+	struct STRING_VIEW
+	{
+		const char*	ptr;
+		u32			len;
+	};
+
+	// zero copy line iterator over a block of memory, usually the data() of a mapped file. the returned
+	// views point into the block and don't include the line ending; empty lines are skipped like in read_line
+	struct FILE_LINES
+	{
+		FILE_LINES(const u8* data, u64 size) : m_ptr((const char*)data), m_end((const char*)data + size) {}
+		FILE_LINES(FILE* file) : m_ptr((const char*)file->data()), m_end((const char*)file->data() + file->size()) {}
+
+		bool next(STRING_VIEW& line)
+		{
+			for (;;)
+			{
+				if (m_ptr == m_end)
+					return false;
+
+				const char* nl = (const char*)memchr(m_ptr, '\n', m_end - m_ptr);
+				const char* end = nl ? nl : m_end;
+
+				line.ptr = m_ptr;
+				m_ptr = nl ? nl + 1 : m_end;
+
+				while (end > line.ptr && end[-1] == '\r')
+					--end;
+				line.len = u32(end - line.ptr);
+				if (line.len)
+					return true;
+			}
+		}
+		bool eof() const
+		{
+			return m_ptr == m_end;
+		}
+		const char* position() const
+		{
+			return m_ptr;
+		}
+
+	private:
+		const char*	m_ptr;
+		const char*	m_end;
+	};
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <xr/core.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FORMAT_INT_MAX		24	// characters format_int can write
+#define FORMAT_FLOAT_MAX	64	// characters format_float can write
+
+namespace xr
+{
+	static const char s_format_digits[] =
+		"00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839" "40414243444546474849"
+		"50515253545556575859" "60616263646566676869" "70717273747576777879" "80818283848586878889" "90919293949596979899";
+
+	// writes exactly 'count' digits of value, zero padded
+	inline void format_digits(char* buf, u64 value, int count)
+	{
+		char* p = buf + count;
+		while (p - buf >= 2)
+		{
+			const u32 d = u32(value % 100) * 2;
+			value /= 100;
+			*--p = s_format_digits[d + 1];
+			*--p = s_format_digits[d];
+		}
+		if (p > buf)
+			*--p = char('0' + value % 10);
+	}
+
+	inline int format_digit_count(u64 value)
+	{
+		int count = 1;
+		for (; value >= 10000; value /= 10000) count += 4;
+		for (; value >= 10; value /= 10) count++;
+		return count;
+	}
+
+	inline int format_uint(char* buf, u64 value)
+	{
+		const int count = format_digit_count(value);
+		format_digits(buf, value, count);
+		return count;
+	}
+
+	inline int format_int(char* buf, i64 value)
+	{
+		if (value < 0)
+		{
+			*buf = '-';
+			return 1 + format_uint(buf + 1, 0 - u64(value));
+		}
+		return format_uint(buf, u64(value));
+	}
+
+	// same text as printf("%.*f", precision, value): the exact binary value rounded half to even.
+	// values below 2^32 take an integer fast path, the rest go through snprintf. precision is 0..9
+	inline int format_float(char* buf, float value, int precision)
+	{
+		static const u64 pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+		u32 bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const int exponent = int(bits >> 23) & 0xff;
+		u64 mantissa = bits & 0x7fffff;
+
+		// value = mantissa * 2^shift
+		int shift;
+		if (exponent)
+		{
+			mantissa |= 0x800000;
+			shift = exponent - 150;
+		}
+		else
+			shift = -149;
+
+		if (exponent == 0xff || shift > 8 || precision < 0 || precision > 9)
+			return snprintf(buf, FORMAT_FLOAT_MAX, "%.*f", precision, double(value));
+
+		// mantissa * 10^precision < 2^54, so the scaled value is exact in 64 bits
+		u64 scaled = mantissa * pow10[precision];
+		if (shift >= 0)
+			scaled <<= shift;
+		else if (shift > -64)
+		{
+			const u64 rest = scaled & ((u64(1) << -shift) - 1);
+			const u64 half = u64(1) << (-shift - 1);
+			scaled >>= -shift;
+			if (rest > half || (rest == half && (scaled & 1)))
+				scaled++;
+		}
+		else
+			scaled = 0;
+
+		char* p = buf;
+		if (bits >> 31)
+			*p++ = '-';
+
+		p += format_uint(p, scaled / pow10[precision]);
+		if (precision)
+		{
+			*p++ = '.';
+			format_digits(p, scaled % pow10[precision], precision);
+			p += precision;
+		}
+		return int(p - buf);
+	}
+}
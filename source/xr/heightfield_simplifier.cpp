@@ -1,5 +1,19 @@
 #include <xr/core.h>
 #include <xr/heightfield_simplifier.h>
+#include <xr/job_manager.h>
+
+#define HF_TILE_LEVELS 4	// quadtree levels split up front into tiles that simplify as separate jobs
+#define HF_PYRAMID_BASE 2	// the finest pyramid level has blocks of 1 << HF_PYRAMID_BASE texels a side
+#define HF_PYRAMID_MAX_LEVELS 16
+#define HF_PYRAMID_MARGIN 1e-5f	// of the coordinates, for the rounding of the exact test
+#define HF_PYRAMID_ROWS 16	// block rows per job while building
+
+#define HF_HOLE		1	// pyramid block flags
+#define HF_WEIGHT	2
+
+#define HF_UNKNOWN		0	// what the pyramid tells of a quad
+#define HF_FLAT			1
+#define HF_NOT_FLAT		2
 
 namespace xr
 {
@@ -13,9 +27,38 @@ namespace xr
 		void simplify(int max_width_per_triangle, float epsilon, MESH* mesh);
 
 	private:
-		void simplify_recursive(int x1, int y1, int x2, int y2);
-		void add_triangle(int i0, int i1, int i2);
-		void process_quads();
+		struct QUAD {
+			int x, y, xsize, ysize;
+
+			QUAD() {}
+			QUAD(int _x, int _y, int _xsize, int _ysize) { x = _x; y = _y; xsize = _xsize; ysize = _ysize; }
+		};
+
+		// a top quadtree node and what simplify_recursive left of it: the cells of its vertices in the order
+		// they were first used, its triangles as cells and its flat quads. process_quads turns the quads into
+		// faces once every tile has its vertices in m_VI
+		struct TILE {
+			int					x1, y1, x2, y2;
+			VECTOR<u8>			used;		// per cell of the tile
+			VECTOR<int>			cells;
+			VECTOR<int>			triangles;
+			VECTOR<QUAD>		quads;
+			VECTOR<MESH::FACE>	faces;
+		};
+
+		// min and max height of the blocks of a pyramid level, and whether any of their texels is a hole or has a weight
+		struct LEVEL {
+			int				width, height;
+			VECTOR<float>	low, high;
+			VECTOR<u8>		flags;
+		};
+
+		void build_pyramid();
+		int  classify_quad(int x1, int y1, int x2, int y2, float low, float high, float plane_low, float plane_high, float span) const;
+		void split_tiles(VECTOR<QUAD>& tiles, int x1, int y1, int x2, int y2, int level);
+		void simplify_recursive(TILE& tile, int x1, int y1, int x2, int y2);
+		void add_triangle(VECTOR<MESH::FACE>& faces, int i0, int i1, int i2);
+		void process_quads(TILE& tile);
 
 		const float*	m_HF;
 		const int*		m_WF;
@@ -23,14 +66,8 @@ namespace xr
 		float			m_scale, m_hole_value, m_epsilon;
 		MESH*			m_mesh;
 		VECTOR<int>		m_VI;
-
-		struct QUAD {
-			int x, y, xsize, ysize;
-
-			QUAD() {}
-			QUAD(int _x, int _y, int _xsize, int _ysize) { x = _x; y = _y; xsize = _xsize; ysize = _ysize; }
-		};
-		VECTOR<QUAD>	m_quads;
+		LEVEL			m_levels[HF_PYRAMID_MAX_LEVELS];
+		int				m_num_levels;
 	};
 
 	void heightfield_simplify(const float* hf, const int* weights, int w, int h, float scale, float hole_value, int max_width_per_triangle, float epsilon, MESH& mesh)
@@ -39,6 +76,8 @@ namespace xr
 		hs.simplify(max_width_per_triangle, epsilon, &mesh);
 	}
 
+	// the tiles simplify in parallel and are merged in the order the serial recursion would visit them, so
+	// the vertices get the same indices and the faces come out in the same order as with a single tile
 	void hf_simplifier::simplify(int max_width_per_triangle, float epsilon, MESH* mesh)
 	{
 		m_max_width_per_triangle = max_width_per_triangle;
@@ -48,23 +87,190 @@ namespace xr
 		m_VI.resize(m_width * m_height);
 		m_VI.fill(-1);
 
-		m_quads.clear();
-
-		simplify_recursive(0, 0, m_width-1, m_height-1);
+		build_pyramid();
+
+		VECTOR<QUAD> rects;
+		split_tiles(rects, 0, 0, m_width-1, m_height-1, 0);
+
+		const int num_tiles = rects.size();
+		TILE* tiles = new TILE[num_tiles];
+		parallel_for(0, num_tiles, 1, [this, tiles, &rects](int t) {
+			TILE& tile = tiles[t];
+			tile.x1 = rects[t].x;
+			tile.y1 = rects[t].y;
+			tile.x2 = rects[t].x + rects[t].xsize;
+			tile.y2 = rects[t].y + rects[t].ysize;
+			tile.used.resize((tile.x2 - tile.x1 + 1) * (tile.y2 - tile.y1 + 1));
+			tile.used.fill(0);
+			simplify_recursive(tile, tile.x1, tile.y1, tile.x2, tile.y2);
+		});
+
+		// cells on the edges between tiles are in more than one list, the first tile to use them numbers them
+		for (int t = 0; t < num_tiles; ++t)
+		{
+			const TILE& tile = tiles[t];
+			for (int i = 0; i < tile.cells.size(); ++i)
+			{
+				const int cell = tile.cells[i];
+				if (m_VI[cell] == -1) {
+					m_VI[cell] = m_mesh->m_positions.size();
+					m_mesh->m_positions.push_back(Vec3((cell % m_width) * m_scale, m_HF[cell], (cell / m_width) * m_scale));
+				}
+			}
+		}
 
-		process_quads();
+		parallel_for(0, num_tiles, 1, [this, tiles](int t) {
+			process_quads(tiles[t]);
+		});
+
+		// the triangles of all the tiles go first and the quads after them, as in the serial recursion
+		VECTOR<int> offsets(num_tiles * 2 + 1);
+		offsets.resize(num_tiles * 2 + 1);
+		offsets[0] = m_mesh->m_faces.size();
+		for (int t = 0; t < num_tiles; ++t)
+			offsets[t + 1] = offsets[t] + tiles[t].triangles.size() / 3;
+		for (int t = 0; t < num_tiles; ++t)
+			offsets[num_tiles + t + 1] = offsets[num_tiles + t] + tiles[t].faces.size();
+		m_mesh->m_faces.resize(offsets[num_tiles * 2]);
+
+		MESH::FACE* faces = m_mesh->m_faces.begin();
+		parallel_for(0, num_tiles, 1, [this, tiles, &offsets, faces, num_tiles](int t) {
+			const TILE& tile = tiles[t];
+			for (int i = 0, n = tile.triangles.size() / 3; i < n; ++i)
+			{
+				MESH::FACE& face = faces[offsets[t] + i];
+				face = MESH::FACE(m_VI[tile.triangles[i*3]], m_VI[tile.triangles[i*3 + 1]], m_VI[tile.triangles[i*3 + 2]]);
+				face.id = 0;
+			}
+			for (int i = 0; i < tile.faces.size(); ++i)
+				faces[offsets[num_tiles + t] + i] = tile.faces[i];
+		});
+		delete[] tiles;
 
 		const int src_verts = m_width * m_height;
 		const int src_faces = (m_width - 1) * (m_height - 1) * 2;
-		const int dst_verts = m_mesh->positions.size();
-		const int dst_faces = m_mesh->faces.size();
+		const int dst_verts = m_mesh->m_positions.size();
+		const int dst_faces = m_mesh->m_faces.size();
 
 		log("HF simplify: %d -> %d verts  %d -> %d tris, eps: %0.4f (%0.3f percent)\n",
-			src_verts, m_mesh->positions.size(), src_faces, m_mesh->faces.size(), m_epsilon, float(dst_faces) * 100.0f / src_faces
+			src_verts, dst_verts, src_faces, dst_faces, m_epsilon, float(dst_faces) * 100.0f / src_faces
 		);
 	}
 
-	void hf_simplifier::simplify_recursive(int x1, int y1, int x2, int y2)
+	void hf_simplifier::build_pyramid()
+	{
+		m_num_levels = 0;
+		for (int size = 1 << HF_PYRAMID_BASE; m_num_levels < HF_PYRAMID_MAX_LEVELS; size *= 2)
+		{
+			LEVEL& level = m_levels[m_num_levels];
+			level.width = (m_width + size - 1) / size;
+			level.height = (m_height + size - 1) / size;
+			const int num_blocks = level.width * level.height;
+			level.low.resize(num_blocks);
+			level.high.resize(num_blocks);
+			level.flags.resize(num_blocks);
+
+			// the first level reads the texels and every other one the level before it
+			const int blocks = (level.height + HF_PYRAMID_ROWS - 1) / HF_PYRAMID_ROWS;
+			parallel_for(0, blocks, 1, [this, &level, size](int b) {
+				const LEVEL* finer = m_num_levels ? &m_levels[m_num_levels - 1] : nullptr;
+				for (int by = b * HF_PYRAMID_ROWS, n = Min(by + HF_PYRAMID_ROWS, level.height); by < n; ++by)
+				{
+					for (int bx = 0; bx < level.width; ++bx)
+					{
+						float low = FLT_MAX, high = -FLT_MAX;
+						u8 flags = 0;
+						if (finer)
+						{
+							for (int y = by*2; y < Min(by*2 + 2, finer->height); ++y)
+								for (int x = bx*2; x < Min(bx*2 + 2, finer->width); ++x)
+								{
+									const int i = x + y*finer->width;
+									low = Min(low, finer->low[i]);
+									high = Max(high, finer->high[i]);
+									flags |= finer->flags[i];
+								}
+						}
+						else
+						{
+							for (int y = by*size; y < Min(by*size + size, m_height); ++y)
+								for (int x = bx*size; x < Min(bx*size + size, m_width); ++x)
+								{
+									const float h = m_HF[x + y*m_width];
+									low = Min(low, h);
+									high = Max(high, h);
+									if (h == m_hole_value) flags |= HF_HOLE;
+									if (m_WF && m_WF[x + y*m_width]) flags |= HF_WEIGHT;
+								}
+						}
+						const int i = bx + by*level.width;
+						level.low[i] = low;
+						level.high[i] = high;
+						level.flags[i] = flags;
+					}
+				}
+			});
+
+			m_num_levels++;
+			if (level.width == 1 && level.height == 1)
+				break;
+		}
+	}
+
+	// HF_NOT_FLAT when the pyramid blocks inside the quad have a hole, a weight or a height out of [low, high].
+	// HF_FLAT when the blocks over it have none of those and their heights together with [plane_low, plane_high]
+	// stay within 'span'. the blocks are the largest that fit 4 times along the shorter side, quads too small for
+	// them are left to the exact test
+	int hf_simplifier::classify_quad(int x1, int y1, int x2, int y2, float low, float high, float plane_low, float plane_high, float span) const
+	{
+		const int side = Min(x2 - x1 + 1, y2 - y1 + 1);
+		int l = -1;
+		while (l + 1 < m_num_levels && (4 << (HF_PYRAMID_BASE + l + 1)) <= side)
+			++l;
+		if (l < 0)
+			return HF_UNKNOWN;
+
+		const LEVEL& level = m_levels[l];
+		const int shift = HF_PYRAMID_BASE + l, size = 1 << shift;
+		const int bx1 = (x1 + size - 1) >> shift, bx2 = (x2 + 1) >> shift;	// blocks [bx1, bx2) are inside
+		const int by1 = (y1 + size - 1) >> shift, by2 = (y2 + 1) >> shift;
+		u8 flags = 0;
+		for (int by = y1 >> shift; by <= (y2 >> shift); ++by)
+		{
+			const bool inside_y = by >= by1 && by < by2;
+			for (int bx = x1 >> shift; bx <= (x2 >> shift); ++bx)
+			{
+				const int i = bx + by*level.width;
+				if (inside_y && bx >= bx1 && bx < bx2 && (level.flags[i] || level.low[i] < low || level.high[i] > high))
+					return HF_NOT_FLAT;
+				flags |= level.flags[i];
+				plane_low = Min(plane_low, level.low[i]);
+				plane_high = Max(plane_high, level.high[i]);
+			}
+		}
+		return !flags && plane_high - plane_low <= span ? HF_FLAT : HF_UNKNOWN;
+	}
+
+	// the nodes simplify_recursive splits whatever the heights are, down to HF_TILE_LEVELS, in the order it visits them
+	void hf_simplifier::split_tiles(VECTOR<QUAD>& tiles, int x1, int y1, int x2, int y2, int level)
+	{
+		if (x1 >= x2 || y1 >= y2) return;
+
+		if (level == HF_TILE_LEVELS || (x2 - x1 < m_max_width_per_triangle && y2 - y1 < m_max_width_per_triangle))
+		{
+			tiles.push_back(QUAD(x1, y1, x2 - x1, y2 - y1));
+			return;
+		}
+
+		const int mx = (x1 + x2) / 2, my = (y1 + y2) / 2;
+
+		split_tiles(tiles, x1, y1, mx, my, level + 1);
+		split_tiles(tiles, x1, my, mx, y2, level + 1);
+		split_tiles(tiles, mx, y1, x2, my, level + 1);
+		split_tiles(tiles, mx, my, x2, y2, level + 1);
+	}
+
+	void hf_simplifier::simplify_recursive(TILE& tile, int x1, int y1, int x2, int y2)
 	{
 		if (x1 >= x2 || y1 >= y2) return;
 
@@ -73,15 +279,16 @@ namespace xr
 			float h = m_HF[x + y*m_width];
 			return Vec4(x*m_scale, h, y*m_scale, m_WF ? m_WF[x + y*m_width] : 0.0f);
 		};
-		auto vertex_index = [this](int x, int y, const Vec4& value) -> int
+		// the cell of the vertex, numbered once all the tiles are done
+		auto vertex_index = [this, &tile](int x, int y, const Vec4& value) -> int
 		{
 			if (value.y == m_hole_value) return -1;
-			int i = x + y*m_width;
-			if (m_VI[i] == -1) {
-				m_VI[i] = m_mesh->positions.size();
-				m_mesh->positions.push_back(value);
+			u8& used = tile.used[(x - tile.x1) + (y - tile.y1)*(tile.x2 - tile.x1 + 1)];
+			if (!used) {
+				used = 1;
+				tile.cells.push_back(x + y*m_width);
 			}
-			return m_VI[i];
+			return x + y*m_width;
 		};
 
 		if (x2 - x1 < m_max_width_per_triangle && y2 - y1 < m_max_width_per_triangle)
@@ -107,7 +314,22 @@ namespace xr
 			if (x2 - x1 > 1 || y2 - y1 > 1)
 			{
 				int dx = x2 - x1, dy = y2 - y1;
-				for (int y = y1; y <= y2 && flat; ++y) {
+
+				// a texel is n.y times its height over the plane off it, and the planes stay within the heights of the
+				// corners, but for the texels past the diagonal that go with the first plane, up to one texel further.
+				// so a texel further off that range than epsilon over the flatter n.y can't be within epsilon, and
+				// all of them are when the range and the texels fit in epsilon over the steeper n.y
+				const float h_low = Min(Min(v11.y, v21.y), Min(v12.y, v22.y));
+				const float h_high = Max(Max(v11.y, v21.y), Max(v12.y, v22.y));
+				const float reach = (h_high - h_low) / Min(dx, dy);
+				const float ny_min = Min(fabsf(n11.y), fabsf(n22.y)), ny_max = Max(fabsf(n11.y), fabsf(n22.y));
+				const float margin = ((x2 + y2) * m_scale + Max(fabsf(h_low), fabsf(h_high)) + m_epsilon) * HF_PYRAMID_MARGIN;
+				const float slack = ny_min > 0 ? (m_epsilon + margin) / ny_min + reach : FLT_MAX;
+				const float span = ny_max > 0 ? (m_epsilon - 2.0f * margin) / ny_max : -1.0f;
+				const int quick = classify_quad(x1, y1, x2, y2, h_low - slack, h_high + slack, h_low - reach, h_high + reach, span);
+				flat = quick != HF_NOT_FLAT;
+
+				for (int y = y1; y <= y2 && flat && quick == HF_UNKNOWN; ++y) {
 
 					int xdiag = x2 - dx * (y - y1) / dy;
 
@@ -141,40 +363,48 @@ namespace xr
 
 			if (x2 - x1 == 1 && y2 - y1 == 1)
 			{
-				add_triangle(i11, i12, i21);
-				add_triangle(i21, i12, i22);
+				if (i11 >= 0 && i12 >= 0 && i21 >= 0) {
+					tile.triangles.push_back(i11); tile.triangles.push_back(i12); tile.triangles.push_back(i21);
+				}
+				if (i21 >= 0 && i12 >= 0 && i22 >= 0) {
+					tile.triangles.push_back(i21); tile.triangles.push_back(i12); tile.triangles.push_back(i22);
+				}
 				return;
 			}
 
 			if (flat)
 			{
-				m_quads.push_back(QUAD(x1, y1, x2 - x1, y2 - y1));
+				tile.quads.push_back(QUAD(x1, y1, x2 - x1, y2 - y1));
 				return;
 			}
 		}
 
 		const int mx = (x1 + x2) / 2, my = (y1 + y2) / 2;
 
-		simplify_recursive(x1, y1, mx, my);
-		simplify_recursive(x1, my, mx, y2);
-		simplify_recursive(mx, y1, x2, my);
-		simplify_recursive(mx, my, x2, y2);
+		simplify_recursive(tile, x1, y1, mx, my);
+		simplify_recursive(tile, x1, my, mx, y2);
+		simplify_recursive(tile, mx, y1, x2, my);
+		simplify_recursive(tile, mx, my, x2, y2);
 	}
 
-	void hf_simplifier::add_triangle(int i0, int i1, int i2)
+	void hf_simplifier::add_triangle(VECTOR<MESH::FACE>& faces, int i0, int i1, int i2)
 	{
-		if( i0 >= 0 && i1 >= 0 && i2 >= 0 )
-			m_mesh->faces.push_back(MESH::FACE(i0,i1,i2));
+		if( i0 >= 0 && i1 >= 0 && i2 >= 0 ) {
+			MESH::FACE face(i0,i1,i2);
+			face.id = 0;
+			faces.push_back(face);
+		}
 	}
 
-	void hf_simplifier::process_quads()
+	// fans over the quads that fill in the vertices their neighbors put on their edges, reading m_VI only
+	void hf_simplifier::process_quads(TILE& tile)
 	{
 		auto index_at_position = [this](int x, int y) -> int
 		{
 			ASSERT(x >= 0 && y >= 0 && x < m_width && y < m_height);
 			return m_VI[x + y*m_width];
 		};
-		auto add_tri_fan = [this,index_at_position](int i_base, int v1, int v2, int axis, bool horizontal, bool include_last) -> int
+		auto add_tri_fan = [this,&tile,index_at_position](int i_base, int v1, int v2, int axis, bool horizontal, bool include_last) -> int
 		{
 			int step = (v2 > v1) ? 1 : -1;
 			if (include_last) v2 += step;
@@ -186,15 +416,15 @@ namespace xr
 				int index = horizontal ? index_at_position(v1, axis) : index_at_position(axis, v1);
 				if (index >= 0) {
 					if (horizontal)
-						add_triangle(i_base, i_prev, index);
+						add_triangle(tile.faces, i_base, i_prev, index);
 					else
-						add_triangle(i_base, index, i_prev);
+						add_triangle(tile.faces, i_base, index, i_prev);
 					i_prev = index;
 				}
 			}
 			return i_prev;
 		};
-		auto add_triangle_fans_tjunctions = [this,index_at_position,add_tri_fan](int x, int y, int xsize, int ysize) -> void	// triangle: (x,y) - (x+xsize,y) - (x,y+ysize)
+		auto add_triangle_fans_tjunctions = [this,&tile,index_at_position,add_tri_fan](int x, int y, int xsize, int ysize) -> void	// triangle: (x,y) - (x+xsize,y) - (x,y+ysize)
 		{
 			ASSERT(xsize*ysize > 0);
 			int xc = 0, yc = 0;
@@ -210,14 +440,12 @@ namespace xr
 
 			if (xc == 2 && yc == 2)
 			{
-				add_triangle(index_at_position(x, y), index_at_position(x, y + ysize), index_at_position(x + xsize, y));
+				add_triangle(tile.faces, index_at_position(x, y), index_at_position(x, y + ysize), index_at_position(x + xsize, y));
 			}
 			else if (xc >= yc)
 			{
 				int i_last = add_tri_fan(index_at_position(x, y + ysize), x + xsize, x, y, true, false);
 				add_tri_fan(i_last, y + ysize, y, x, false, true);
-				int i = 0;
-				i;
 			}
 			else
 			{
@@ -226,15 +454,15 @@ namespace xr
 			}
 		};
 
-		for (int i = 0; i < m_quads.size(); ++i)
+		for (int i = 0; i < tile.quads.size(); ++i)
 		{
-			const QUAD& q = m_quads[i];
+			const QUAD& q = tile.quads[i];
 			{
 				add_triangle_fans_tjunctions(q.x, q.y, q.xsize, q.ysize);
 				add_triangle_fans_tjunctions(q.x + q.xsize, q.y + q.ysize, -q.xsize, -q.ysize);
 			}
 		}
-		m_quads.clear();
+		tile.quads.clear();
 	}
 }
 
@@ -1,163 +1,766 @@
 #include <xr/job_manager.h>
 #include <xr/vector.h>
 #include <xr/threads.h>
-#include <process.h>
-#include <windows.h>
+#include <xr/time.h>
+#include <xr/file.h>
+#include <stdio.h>
+#include <thread>
 
-#define MAX_JOBS 4096
-#define MAX_WORKER_THREADS 32
+#define WORKER_SPIN_COUNT 64
+
+#define JOB_SEGMENT_BITS 12
+#define JOB_SEGMENT_SIZE (1 << JOB_SEGMENT_BITS)
+#define MAX_JOB_SEGMENTS 4096
+#define JOB_FREE_BATCH 128
+#define JOB_LOCAL_FREE_MAX (JOB_FREE_BATCH * 4)
+#define JOB_DEQUE_SIZE 1024
+
+#define JOB_PROFILE_RING_SIZE (1 << 16)
+#define MAX_PROFILE_THREADS (MAX_WORKER_THREADS + 32)
 
 namespace xr
 {
-	int s_job_type_count[256];
-
 	struct JOB
 	{
-		std::function<void()> f;
-		u32*	counter;
-		u32*	counter_to_wait;
-		int		next;
-		EVENT	event;
+		JOB_FUNCTION		f;
+		JOB_COUNTER*		counter;
+		std::atomic<JOB*>	next;	// free list, injection queue or the waiting list of a counter
+		std::atomic<u32>	generation;
+		u32					index;
+		const char*			label;
+		u64					submit_ticks;
+		bool				profiled;	// counted in the profiler queue depth
+	};
+
+	// Chase-Lev work stealing deque: the owner pushes and pops at the bottom, thieves steal from the top.
+	// The ring doubles when full; replaced rings stay alive until shutdown since thieves may still read them.
+	struct JOB_DEQUE
+	{
+		struct RING
+		{
+			RING(i64 capacity, RING* prev) : m_capacity(capacity), m_items(new std::atomic<JOB*>[capacity]), m_prev(prev) {}
+			~RING()
+			{
+				delete[] m_items;
+				delete m_prev;
+			}
+
+			JOB* get(i64 i) const { return m_items[i & (m_capacity - 1)].load(std::memory_order_relaxed); }
+			void put(i64 i, JOB* job) { m_items[i & (m_capacity - 1)].store(job, std::memory_order_relaxed); }
+
+			i64					m_capacity;
+			std::atomic<JOB*>*	m_items;
+			RING*				m_prev;
+		};
+
+		alignas(64) std::atomic<i64>	m_top;
+		alignas(64) std::atomic<i64>	m_bottom;
+		std::atomic<RING*>				m_ring;
+
+		JOB_DEQUE() : m_top(0), m_bottom(0), m_ring(new RING(JOB_DEQUE_SIZE, nullptr))
+		{
+		}
+		~JOB_DEQUE()
+		{
+			delete m_ring.load();
+		}
+
+		void push(JOB* job)
+		{
+			i64 b = m_bottom.load(std::memory_order_relaxed);
+			i64 t = m_top.load(std::memory_order_acquire);
+			RING* ring = m_ring.load(std::memory_order_relaxed);
+			if (b - t >= ring->m_capacity)
+			{
+				RING* grown = new RING(ring->m_capacity * 2, ring);
+				for (i64 i = t; i < b; ++i)
+					grown->put(i, ring->get(i));
+				m_ring.store(grown, std::memory_order_release);
+				ring = grown;
+			}
+			ring->put(b, job);
+			m_bottom.store(b + 1, std::memory_order_release);
+		}
+		JOB* pop()
+		{
+			i64 b = m_bottom.load(std::memory_order_relaxed) - 1;
+			RING* ring = m_ring.load(std::memory_order_relaxed);
+			m_bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			i64 t = m_top.load(std::memory_order_relaxed);
+
+			if (t > b)
+			{
+				m_bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			JOB* job = ring->get(b);
+			if (t == b)
+			{
+				// last item - race against thieves
+				if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					job = nullptr;
+				m_bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+		JOB* steal()
+		{
+			i64 t = m_top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			i64 b = m_bottom.load(std::memory_order_acquire);
+			if (t >= b)
+				return nullptr;
+
+			JOB* job = m_ring.load(std::memory_order_acquire)->get(t);
+			if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return nullptr;
+			return job;
+		}
+	};
+
+	// unbounded intrusive queue for jobs submitted from non-worker threads: producers never block,
+	// consumers take turns through a try-lock and treat a busy queue as empty
+	struct JOB_QUEUE
+	{
+		alignas(64) std::atomic<JOB*>	m_head;
+		alignas(64) JOB*				m_tail;
+		std::atomic<bool>				m_consumer;
+		JOB								m_stub;
+
+		JOB_QUEUE() : m_head(&m_stub), m_tail(&m_stub), m_consumer(false)
+		{
+			m_stub.next.store(nullptr, std::memory_order_relaxed);
+		}
+		void push(JOB* job)
+		{
+			job->next.store(nullptr, std::memory_order_relaxed);
+			JOB* prev = m_head.exchange(job, std::memory_order_acq_rel);
+			prev->next.store(job, std::memory_order_release);
+		}
+		JOB* pop()
+		{
+			if (m_consumer.exchange(true, std::memory_order_acquire))
+				return nullptr;
+
+			JOB* job = pop_single();
+			m_consumer.store(false, std::memory_order_release);
+			return job;
+		}
+
+	private:
+		JOB* pop_single()
+		{
+			JOB* tail = m_tail;
+			JOB* next = tail->next.load(std::memory_order_acquire);
+			if (tail == &m_stub)
+			{
+				if (!next)
+					return nullptr;
+				m_tail = next;
+				tail = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+			if (next)
+			{
+				m_tail = next;
+				return tail;
+			}
+			if (tail != m_head.load(std::memory_order_acquire))
+				return nullptr;	// a producer is half way through a push
+
+			push(&m_stub);
+			next = tail->next.load(std::memory_order_acquire);
+			if (next)
+			{
+				m_tail = next;
+				return tail;
+			}
+			return nullptr;
+		}
+	};
+
+	// job slots are never freed but recycled through per-thread free lists, which exchange batches
+	// with a shared list; a new segment is allocated only when every slot is in use
+	struct JOB_FREE_LIST
+	{
+		JOB*	m_head;
+		int		m_count;
+
+		JOB_FREE_LIST() : m_head(nullptr), m_count(0) {}
+		~JOB_FREE_LIST();
 	};
 
-	JOB		s_jobs[MAX_JOBS];
-	int		s_free;
-	int		s_first;
-	int		s_num_jobs;
+	JOB*				s_segments[MAX_JOB_SEGMENTS];
+	int					s_num_segments;
+	JOB*				s_shared_free;
+	CRITICAL_SECTION	s_pool_cs;
+
+	std::atomic<int>	s_num_jobs;
+	std::atomic<int>	s_num_sleeping;
+	std::atomic<int>	s_num_running;
+	std::atomic<bool>	s_quit;
+
+	JOB_DEQUE			s_deques[MAX_WORKER_THREADS];
+	JOB_QUEUE			s_injected;
+	int					s_num_workers;
 
 	EVENT	s_any_job;
 	EVENT	s_no_jobs;
 
-	CRITICAL_SECTION s_cs;
+	THREAD	s_worker_threads[MAX_WORKER_THREADS];
 
-	uintptr_t	s_worker_threads[MAX_WORKER_THREADS];
+	static thread_local int				s_worker_index = -1;
+	static thread_local JOB_FREE_LIST	s_free_list;
 
+	struct JOB_PROFILE_EVENT
+	{
+		const char*	label;
+		u64			submit, start, end;
+	};
 
-	JOB_HANDLE jobs_add(std::function<void()> func, u32& counter, u32* counter_to_wait)
+	// ring of the last JOB_PROFILE_RING_SIZE jobs run by one thread, written only by that thread
+	struct JOB_PROFILE_THREAD
 	{
-		CS_SCOPE(s_cs);
+		int					worker;
+		u32					count;
+		u32					steals;
+		u64					busy_ticks;
+		JOB_PROFILE_EVENT	events[JOB_PROFILE_RING_SIZE];
+	};
+
+	std::atomic<bool>	s_profiling;
+	u64					s_profile_begin, s_profile_end;
+	std::atomic<int>	s_profile_queued;
+	std::atomic<int>	s_profile_max_queued;
+	JOB_PROFILE_THREAD*	s_profile_threads[MAX_PROFILE_THREADS];
+	int					s_num_profile_threads;
+
+	static thread_local JOB_PROFILE_THREAD*	s_profile_thread;
 
-		if (s_free == -1)
+	static JOB_PROFILE_THREAD* profile_thread()
+	{
+		if (!s_profile_thread)
 		{
-			return -1;
+			CS_SCOPE(s_pool_cs);
+			if (s_num_profile_threads == MAX_PROFILE_THREADS)
+				return nullptr;
+
+			JOB_PROFILE_THREAD* pt = new JOB_PROFILE_THREAD;
+			pt->worker = s_worker_index;
+			pt->count = pt->steals = 0;
+			pt->busy_ticks = 0;
+
+			s_profile_threads[s_num_profile_threads++] = pt;
+			s_profile_thread = pt;
 		}
+		return s_profile_thread;
+	}
+
+	static void release_free_jobs(JOB_FREE_LIST& list, int count)
+	{
+		JOB* first = list.m_head;
+		JOB* last = first;
+		for (int i = 1; i < count; ++i)
+			last = last->next.load(std::memory_order_relaxed);
+
+		list.m_head = last->next.load(std::memory_order_relaxed);
+		list.m_count -= count;
 
-		int curr = s_free;
-		s_free = s_jobs[s_free].next;
+		CS_SCOPE(s_pool_cs);
+		last->next.store(s_shared_free, std::memory_order_relaxed);
+		s_shared_free = first;
+	}
 
-		JOB& job = s_jobs[curr];
+	JOB_FREE_LIST::~JOB_FREE_LIST()
+	{
+		if (m_count)
+			release_free_jobs(*this, m_count);
+	}
 
-		job.f = func;
-		job.counter_to_wait = counter_to_wait;
-		job.counter = &counter;
-		job.next = s_first;
+	static void acquire_free_jobs(JOB_FREE_LIST& list)
+	{
+		CS_SCOPE(s_pool_cs);
 
-		s_first = curr;
+		if (!s_shared_free)
+		{
+			ASSERT(s_num_segments < MAX_JOB_SEGMENTS);
 
-		if (counter)
-			InterlockedIncrement(&counter);
+			JOB* segment = new JOB[JOB_SEGMENT_SIZE];
+			for (int i = 0; i < JOB_SEGMENT_SIZE; ++i)
+			{
+				segment[i].index = (s_num_segments << JOB_SEGMENT_BITS) | i;
+				segment[i].generation.store(0, std::memory_order_relaxed);
+				segment[i].next.store(i + 1 < JOB_SEGMENT_SIZE ? &segment[i + 1] : nullptr, std::memory_order_relaxed);
+			}
+			s_segments[s_num_segments++] = segment;
 
-		s_num_jobs++;
+			list.m_head = segment;
+			list.m_count = JOB_SEGMENT_SIZE;
+			return;
+		}
 
-		s_any_job.signal();
-		s_no_jobs.reset();
+		int count = 1;
+		JOB* last = s_shared_free;
+		for (; count < JOB_FREE_BATCH && last->next.load(std::memory_order_relaxed); ++count)
+			last = last->next.load(std::memory_order_relaxed);
 
-		return JOB_HANDLE(curr);
+		list.m_head = s_shared_free;
+		list.m_count = count;
+		s_shared_free = last->next.load(std::memory_order_relaxed);
+		last->next.store(nullptr, std::memory_order_relaxed);
 	}
 
-	void jobs_wait_job(JOB_HANDLE h)
+	static void free_job(JOB* job)
+	{
+		JOB_FREE_LIST& list = s_free_list;
+		job->next.store(list.m_head, std::memory_order_relaxed);
+		list.m_head = job;
+		if (++list.m_count > JOB_LOCAL_FREE_MAX)
+			release_free_jobs(list, JOB_FREE_BATCH);
+	}
+
+	static void push_job(JOB* job)
+	{
+		job->profiled = s_profiling.load(std::memory_order_relaxed);
+		if (job->profiled)
+		{
+			int queued = s_profile_queued.fetch_add(1, std::memory_order_relaxed) + 1;
+			int max_queued = s_profile_max_queued.load(std::memory_order_relaxed);
+			while (queued > max_queued && !s_profile_max_queued.compare_exchange_weak(max_queued, queued, std::memory_order_relaxed));
+		}
+
+		if (s_worker_index >= 0)
+			s_deques[s_worker_index].push(job);
+		else
+			s_injected.push(job);
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (s_num_sleeping.load(std::memory_order_relaxed) > 0)
+			s_any_job.signal();
+	}
+
+	static JOB* find_job()
 	{
-		s_jobs[h].event.wait();
+		const int worker = s_worker_index;
+
+		JOB* job = (worker >= 0) ? s_deques[worker].pop() : nullptr;
+		if (job)
+			return job;
+
+		job = s_injected.pop();
+		if (job)
+			return job;
+
+		// steal from the other workers, starting next to ourselves to spread the victims
+		for (int i = 1; i <= s_num_workers; ++i)
+		{
+			int victim = (worker + i) % s_num_workers;
+			if (victim == worker)
+				continue;
+			job = s_deques[victim].steal();
+			if (job)
+			{
+				if (s_profiling.load(std::memory_order_relaxed))
+				{
+					JOB_PROFILE_THREAD* pt = profile_thread();
+					if (pt) pt->steals++;
+				}
+				return job;
+			}
+		}
+		return nullptr;
 	}
 
-	void jobs_wait_type(int job_type)
+	static void run_job(JOB* job)
 	{
-		job_type;
+		if (job->profiled)
+			s_profile_queued.fetch_sub(1, std::memory_order_relaxed);
+
+		if (s_profiling.load(std::memory_order_relaxed))
+		{
+			JOB_PROFILE_THREAD* pt = profile_thread();
+
+			const u64 start = get_ticks();
+			job->f();
+			const u64 end = get_ticks();
+
+			if (pt)
+			{
+				JOB_PROFILE_EVENT& e = pt->events[pt->count++ & (JOB_PROFILE_RING_SIZE - 1)];
+				e.label = job->label;
+				e.submit = job->submit_ticks ? job->submit_ticks : start;
+				e.start = start;
+				e.end = end;
+				pt->busy_ticks += end - start;
+			}
+		}
+		else
+			job->f();
+
+		job->f.reset();
+
+		JOB_COUNTER* counter = job->counter;
+
+		job->generation.fetch_add(1, std::memory_order_release);
+		free_job(job);
+
+		if (counter)
+			counter->decrement();
+
+		if (s_num_jobs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			s_no_jobs.signal();
 	}
 
-	void jobs_wait_all()
+	static void release_waiters(JOB_COUNTER* counter)
 	{
-		if (s_num_jobs)
+		JOB* job = counter->m_waiters.exchange(nullptr, std::memory_order_acquire);
+		while (job)
 		{
-			s_no_jobs.wait();
+			JOB* next = job->next.load(std::memory_order_relaxed);
+			push_job(job);
+			job = next;
 		}
 	}
 
-	unsigned __stdcall jobs_worker_thread(void*)
+	static bool run_pending_job()
 	{
+		JOB* job = find_job();
+		if (!job)
+			return false;
+		run_job(job);
+		return true;
+	}
+
+	JOB_COUNTER::JOB_COUNTER() : m_count(0), m_waiters(nullptr)
+	{
+	}
+
+	void JOB_COUNTER::increment(int count)
+	{
+		int c = m_count.load(std::memory_order_relaxed);
 		for (;;)
 		{
-			s_cs.enter();
+			if (c < 0)
+			{
+				std::this_thread::yield();
+				c = m_count.load(std::memory_order_relaxed);
+			}
+			else if (m_count.compare_exchange_weak(c, c + count, std::memory_order_acq_rel, std::memory_order_relaxed))
+				return;
+		}
+	}
 
-			int job = -1, prev_job = -1;
-			for ( job = s_first; job >= 0; prev_job = job, job = s_jobs[job].next)
+	void JOB_COUNTER::decrement()
+	{
+		int c = m_count.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			ASSERT(c != 0);
+			if (c < 0)
 			{
-				JOB& curr_job = s_jobs[job];
-				if (curr_job.type_wait && s_job_type_count[curr_job.type_wait] > 0) continue;
-				break;
+				std::this_thread::yield();
+				c = m_count.load(std::memory_order_relaxed);
+			}
+			else if (c > 1)
+			{
+				if (m_count.compare_exchange_weak(c, c - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+					return;
 			}
+			else if (m_count.compare_exchange_weak(c, -1, std::memory_order_acq_rel, std::memory_order_relaxed))
+				break;
+		}
+
+		// the count stays at -1 until the waiting jobs are released, so a waiter can not return
+		// and destroy the counter while we still touch it
+		release_waiters(this);
+		m_event.signal();
+		m_count.store(0, std::memory_order_release);
+	}
+
+	void JOB_COUNTER::wait()
+	{
+		for (;;)
+		{
+			int c = m_count.load(std::memory_order_acquire);
+			if (c == 0)
+				return;
+			if (run_pending_job())
+				continue;
+			if (c < 0)
+				std::this_thread::yield();
+			else
+				m_event.wait(1);
+		}
+	}
+
+	JOB* jobs_alloc()
+	{
+		JOB_FREE_LIST& list = s_free_list;
+		if (!list.m_head)
+			acquire_free_jobs(list);
+
+		JOB* job = list.m_head;
+		list.m_head = job->next.load(std::memory_order_relaxed);
+		list.m_count--;
+		return job;
+	}
+
+	JOB_FUNCTION& jobs_function(JOB* job)
+	{
+		return job->f;
+	}
+
+	JOB_HANDLE jobs_submit(JOB* job, JOB_COUNTER* counter, JOB_COUNTER* counter_to_wait, const char* label)
+	{
+		job->counter = counter;
+		job->label = label;
+		job->submit_ticks = s_profiling.load(std::memory_order_relaxed) ? get_ticks() : 0;
+
+		if (counter)
+			counter->increment();
+
+		s_num_jobs.fetch_add(1, std::memory_order_relaxed);
 
-			if (job >= 0)
+		const JOB_HANDLE handle = (JOB_HANDLE(job->generation.load(std::memory_order_relaxed)) << 32) | job->index;
+
+		if (!counter_to_wait)
+		{
+			push_job(job);
+		}
+		else
+		{
+			// park the job on the counter, the decrement that brings it to zero will push it
+			JOB* head = counter_to_wait->m_waiters.load(std::memory_order_relaxed);
+			do
 			{
-				if (prev_job > -1)
-					s_jobs[prev_job].next = s_jobs[job].next;
-				else
-					s_first = s_jobs[job].next;
+				job->next.store(head, std::memory_order_relaxed);
+			} while (!counter_to_wait->m_waiters.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+
+			int c;
+			while ((c = counter_to_wait->m_count.load(std::memory_order_acquire)) < 0)
+				std::this_thread::yield();
+			if (c == 0)
+				release_waiters(counter_to_wait);
+		}
 
-				s_cs.leave();
+		return handle;
+	}
 
-				s_jobs[job].f();
+	void jobs_wait_job(JOB_HANDLE h)
+	{
+		const u32 index = u32(h & 0xFFFFFFFF);
+		const u32 generation = u32(h >> 32);
 
-				s_cs.enter();
+		const JOB& job = s_segments[index >> JOB_SEGMENT_BITS][index & (JOB_SEGMENT_SIZE - 1)];
 
-				s_jobs[job].next = s_free;
-				s_free = job;
-				s_job_type_count[s_jobs[job].type] --;
+		while (job.generation.load(std::memory_order_acquire) == generation)
+		{
+			if (!run_pending_job())
+				std::this_thread::yield();
+		}
+	}
 
-				s_num_jobs--;
-				if (s_num_jobs == 0) s_no_jobs.signal();
+	void jobs_wait_all()
+	{
+		while (s_num_jobs.load(std::memory_order_acquire) > 0)
+		{
+			if (!run_pending_job())
+				s_no_jobs.wait(1);
+		}
+	}
 
-				s_jobs[job].event.signal();
+	void jobs_profile_begin()
+	{
+		CS_SCOPE(s_pool_cs);
+		for (int i = 0; i < s_num_profile_threads; ++i)
+		{
+			s_profile_threads[i]->count = s_profile_threads[i]->steals = 0;
+			s_profile_threads[i]->busy_ticks = 0;
+		}
+		s_profile_queued = 0;
+		s_profile_max_queued = 0;
+		s_profile_begin = get_ticks();
+		s_profile_end = 0;
+		s_profiling = true;
+	}
+
+	void jobs_profile_end()
+	{
+		s_profiling = false;
+		s_profile_end = get_ticks();
+	}
+
+	void jobs_profile_stats(JOBS_PROFILE_STATS& stats)
+	{
+		memset(&stats, 0, sizeof(stats));
+
+		const u64 end = s_profile_end ? s_profile_end : get_ticks();
+		const float ticks_to_ms = 1000.0f / float(get_ticks_frequency());
+		const float wall_ms = float(end - s_profile_begin) * ticks_to_ms;
 
-				s_cs.leave();
+		stats.num_workers = s_num_workers;
+		stats.max_queue_depth = s_profile_max_queued.load();
+
+		for (int i = 0; i < s_num_workers; ++i)
+			stats.idle_ms[i] = wall_ms;
+
+		CS_SCOPE(s_pool_cs);
+		for (int i = 0; i < s_num_profile_threads; ++i)
+		{
+			const JOB_PROFILE_THREAD* pt = s_profile_threads[i];
+			stats.num_jobs += pt->count;
+			stats.num_steals += pt->steals;
+			if (pt->worker >= 0)
+			{
+				stats.busy_ms[pt->worker] = float(pt->busy_ticks) * ticks_to_ms;
+				stats.idle_ms[pt->worker] = Max(wall_ms - stats.busy_ms[pt->worker], 0.0f);
 			}
+		}
+	}
+
+	bool jobs_profile_dump(const char* filename)
+	{
+		FILE* fp = FILE::open(filename, FILE::WRITE | FILE::TRUNC);
+		if (!fp)
+		{
+			log("ERROR: can not create '%s' file!\n", filename);
+			return false;
+		}
+
+		const double ticks_to_us = 1000000.0 / double(get_ticks_frequency());
+		auto us = [ticks_to_us](u64 ticks) -> double
+		{
+			return double(ticks - s_profile_begin) * ticks_to_us;
+		};
+
+		JOBS_PROFILE_STATS stats;
+		jobs_profile_stats(stats);
+
+		char buf[512];
+		const char* separator = "";
+
+		fp->printf("{\"traceEvents\":[\n");
+
+		CS_SCOPE(s_pool_cs);
+		for (int i = 0; i < s_num_profile_threads; ++i)
+		{
+			const JOB_PROFILE_THREAD* pt = s_profile_threads[i];
+
+			if (pt->worker >= 0)
+				snprintf(buf, sizeof(buf), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", separator, i, pt->worker);
 			else
+				snprintf(buf, sizeof(buf), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", separator, i, i);
+			fp->printf("%s", buf);
+			separator = ",\n";
+
+			const u32 first = pt->count > JOB_PROFILE_RING_SIZE ? pt->count - JOB_PROFILE_RING_SIZE : 0;
+			for (u32 j = first; j < pt->count; ++j)
 			{
-				s_cs.leave();
-				s_any_job.wait();
+				const JOB_PROFILE_EVENT& e = pt->events[j & (JOB_PROFILE_RING_SIZE - 1)];
+
+				char label[128];
+				size_t len = 0;
+				for (const char* c = e.label ? e.label : "job"; *c && len + 1 < sizeof(label); ++c)
+					label[len++] = (*c == '"' || *c == '\\') ? '_' : *c;
+				label[len] = 0;
+
+				snprintf(buf, sizeof(buf), ",\n{\"name\":\"%s\",\"cat\":\"job\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"queued_us\":%.3f}}",
+					label, i, us(e.start), double(e.end - e.start) * ticks_to_us, double(e.start - e.submit) * ticks_to_us);
+				fp->printf("%s", buf);
 			}
 		}
+
+		snprintf(buf, sizeof(buf), "\n],\n\"otherData\":{\"jobs\":%u,\"steals\":%u,\"max_queue_depth\":%u", stats.num_jobs, stats.num_steals, stats.max_queue_depth);
+		fp->printf("%s", buf);
+		for (int i = 0; i < stats.num_workers; ++i)
+		{
+			snprintf(buf, sizeof(buf), ",\"worker %d busy_ms\":%.3f,\"worker %d idle_ms\":%.3f", i, stats.busy_ms[i], i, stats.idle_ms[i]);
+			fp->printf("%s", buf);
+		}
+		fp->printf("}}\n");
+
+		delete fp;
+		return true;
 	}
 
-	void jobs_init(int num_threads)
+	static void jobs_worker_thread(void* param)
 	{
-		for (int i = 0; i < MAX_JOBS; ++i)
+		s_worker_index = int(intptr_t(param));
+		s_num_running.fetch_add(1);
+
+		while (!s_quit.load(std::memory_order_relaxed))
 		{
-			s_jobs[i].next = (i + 1 == MAX_JOBS) ? -1 : i + 1;
+			if (run_pending_job())
+			{
+				// there may be more work for the sleeping workers, ramp them up one by one
+				if (s_num_sleeping.load(std::memory_order_relaxed) > 0)
+					s_any_job.signal();
+				continue;
+			}
+
+			int spin = 0;
+			for (; spin < WORKER_SPIN_COUNT; ++spin)
+			{
+				std::this_thread::yield();
+				if (run_pending_job()) break;
+			}
+			if (spin < WORKER_SPIN_COUNT)
+				continue;
+
+			s_num_sleeping.fetch_add(1);
+			if (!run_pending_job())
+				s_any_job.wait();
+			s_num_sleeping.fetch_sub(1);
 		}
-		s_first = -1;
-		s_free = 0;
+
+		s_num_running.fetch_sub(1);
+	}
+
+	void jobs_init(int num_threads)
+	{
+		s_quit = false;
+		if (num_threads <= 0)
+			num_threads = Max(get_num_cores() - 1, 1);
+		s_num_workers = Min(num_threads, MAX_WORKER_THREADS);
 
 		for (int i = 0; i < MAX_WORKER_THREADS; ++i)
 		{
-			if (i < num_threads)
+			if (i < s_num_workers)
 			{
-				s_worker_threads[i] = _beginthreadex(NULL, 1024 * 1024, jobs_worker_thread, NULL, 0, NULL);
+				s_worker_threads[i] = thread_create(jobs_worker_thread, (void*)intptr_t(i), 1024 * 1024);
 			}
 			else
-				s_worker_threads[i] = 0;
+				s_worker_threads[i] = nullptr;
 		}
 
 		s_no_jobs.signal();
 	}
+
 	void jobs_done()
 	{
+		jobs_wait_all();
+
+		s_quit = true;
+		while (s_num_running.load() > 0)
+		{
+			s_any_job.signal();
+			std::this_thread::yield();
+		}
+
 		for (int i = 0; i < MAX_WORKER_THREADS; ++i)
 		{
 			if (s_worker_threads[i])
 			{
-				//ExitThread(s_worker_threads[i]);
+				thread_join(s_worker_threads[i]);
+				s_worker_threads[i] = nullptr;
 			}
 		}
+		s_num_workers = 0;
+	}
+
+	int jobs_num_workers()
+	{
+		return s_num_workers;
 	}
-}
\ No newline at end of file
+}
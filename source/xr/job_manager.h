@@ -1,26 +1,144 @@
 #pragma once
 
-#include <functional>
+#include <xr/core.h>
+#include <xr/threads.h>
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#define MAX_WORKER_THREADS 128
 
 namespace xr
 {
-	typedef int JOB_HANDLE;
+	typedef u64 JOB_HANDLE;	// (generation << 32) | job index
+
+	struct JOB;
+
+	// type erased job closure, kept inline in the job slot; only closures that don't fit go to the heap
+	class JOB_FUNCTION
+	{
+	public:
+		enum { INLINE_SIZE = 64 };
+
+		JOB_FUNCTION() : m_invoke(nullptr), m_destroy(nullptr) {}
+		~JOB_FUNCTION() { reset(); }
 
+		JOB_FUNCTION(const JOB_FUNCTION&) = delete;
+		JOB_FUNCTION& operator = (const JOB_FUNCTION&) = delete;
+
+		template< class F > void set(F&& f)
+		{
+			typedef typename std::decay<F>::type T;
+
+			reset();
+			if constexpr (sizeof(T) <= INLINE_SIZE && alignof(T) <= 16)
+			{
+				new (m_storage) T(std::forward<F>(f));
+				m_invoke = [](void* p) { (*(T*)p)(); };
+				m_destroy = [](void* p) { ((T*)p)->~T(); };
+			}
+			else
+			{
+				*(T**)m_storage = new T(std::forward<F>(f));
+				m_invoke = [](void* p) { (**(T**)p)(); };
+				m_destroy = [](void* p) { delete *(T**)p; };
+			}
+		}
+		void operator()()
+		{
+			m_invoke(m_storage);
+		}
+		void reset()
+		{
+			if (m_destroy)
+				m_destroy(m_storage);
+			m_invoke = nullptr;
+			m_destroy = nullptr;
+		}
+
+	private:
+		alignas(16) u8	m_storage[INLINE_SIZE];
+		void			(*m_invoke)(void*);
+		void			(*m_destroy)(void*);
+	};
+
+	// counts the unfinished jobs added with it; jobs added with it as 'counter_to_wait' are held back
+	// and only become runnable once the count drops to zero, which lets dependent stages overlap
 	struct JOB_COUNTER
 	{
 		JOB_COUNTER();
-		void wait();
 
-		u32		m_count;
-		EVENT	m_event;
+		void increment(int count = 1);
+		void decrement();	// the last decrement releases the jobs waiting on this counter
+		void wait();		// runs pending jobs on the calling thread until the counter drops to zero
+
+		std::atomic<int>	m_count;	// -1 while the last decrement is releasing the waiting jobs
+		std::atomic<JOB*>	m_waiters;	// list of jobs waiting for this counter
+		EVENT				m_event;
 	};
 
-	void jobs_init(int num_threads);
+	void jobs_init(int num_threads);	// num_threads <= 0 starts a worker for every core but the calling one
 	void jobs_done();
+	int  jobs_num_workers();	// 0 outside jobs_init / jobs_done, the jobs then run on the thread that waits for them
 
-	JOB_HANDLE jobs_add(std::function<void()> func, JOB_COUNTER* counter = nullptr, JOB_COUNTER* counter_to_wait = nullptr);
+	// jobs_add is split in three so the closure is constructed straight into a pooled job slot
+	JOB*			jobs_alloc();
+	JOB_FUNCTION&	jobs_function(JOB* job);
+	JOB_HANDLE		jobs_submit(JOB* job, JOB_COUNTER* counter, JOB_COUNTER* counter_to_wait, const char* label);
+
+	// 'label' must be a string literal or otherwise outlive the profile dump
+	template< class F > JOB_HANDLE jobs_add(F&& func, JOB_COUNTER* counter = nullptr, JOB_COUNTER* counter_to_wait = nullptr, const char* label = nullptr)
+	{
+		JOB* job = jobs_alloc();
+		jobs_function(job).set(std::forward<F>(func));
+		return jobs_submit(job, counter, counter_to_wait, label);
+	}
 
 	void jobs_wait_job(JOB_HANDLE h);
-	void jobs_wait_type(int job_type);
 	void jobs_wait_all();
-}
\ No newline at end of file
+
+	// job profiler: while enabled each job records its submit, start and end ticks, the thread that ran
+	// it and its label into per-thread ring buffers; dump after the jobs of interest have finished
+	struct JOBS_PROFILE_STATS
+	{
+		u32		num_jobs;
+		u32		num_steals;
+		u32		max_queue_depth;
+		int		num_workers;
+		float	busy_ms[MAX_WORKER_THREADS];
+		float	idle_ms[MAX_WORKER_THREADS];
+	};
+
+	void jobs_profile_begin();
+	void jobs_profile_end();
+	void jobs_profile_stats(JOBS_PROFILE_STATS& stats);
+	bool jobs_profile_dump(const char* filename);	// Chrome trace event JSON, open in chrome://tracing
+
+	// runs fn(i) for every i in [begin, end) in chunks of 'grain' indices; blocks until done unless
+	// a counter is given, in which case the chunks are tracked by it and the call returns immediately
+	template< class F > void parallel_for(int begin, int end, int grain, F fn, JOB_COUNTER* counter = nullptr, JOB_COUNTER* counter_to_wait = nullptr, const char* label = nullptr)
+	{
+		JOB_COUNTER local;
+		JOB_COUNTER* chunk_counter = counter ? counter : &local;
+
+		// hold the counter up while adding so jobs waiting on it can't be released between chunks
+		chunk_counter->increment();
+
+		grain = Max(grain, 1);
+		for (int i = begin; i < end; i += grain)
+		{
+			const int chunk_end = Min(i + grain, end);
+			jobs_add([fn, i, chunk_end]() {
+				for (int j = i; j < chunk_end; ++j)
+					fn(j);
+			}, chunk_counter, counter_to_wait, label);
+		}
+
+		chunk_counter->decrement();
+
+		if (!counter)
+			local.wait();
+	}
+}
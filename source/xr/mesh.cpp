@@ -1,11 +1,26 @@
 #include <xr/mesh.h>
+#include <xr/vec3_kernels.h>
 #include <xr/file.h>
-#include <xr/hash.h>
+#include <xr/job_manager.h>
+#include <xr/format.h>
 #include <algorithm>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <functional>
+#include <atomic>
+#include <math.h>
+#include <ctype.h>
+
+#define MESH_EXPORT_BUFFER_SIZE (4 * 1024 * 1024)
+#define MESH_RECORD_MAX 512
+#define ADJACENCY_BLOCK (16 * 1024)	// vertices or faces per job when building adjacency
+#define MESH_RING_MAX 64			// neighbors can_collapse_edge looks at, busier vertices aren't collapsed
+#define WELD_CELL_MAX 1073741824.0f	// grid coordinates quantize_vertices clamps to
+#define VERTEX_CACHE_SIZE 32			// lru cache optimize_vertex_cache scores against
+#define VERTEX_VALENCE_MAX 32			// remaining face counts with a precomputed score
+#define OVERDRAW_CACHE_SIZE 16			// fifo cache optimize_overdraw measures its clusters with
+#define NORMALS_PARTIAL_MAX 8			// per thread normal sums of compute_vertex_normals, more workers get longer face runs
 
 namespace xr
 {
@@ -17,9 +32,40 @@ namespace xr
 	};
 
 
+	// one text record of the exporters, formatted straight into the file buffer
+	struct TEXT_RECORD
+	{
+		TEXT_RECORD(FILE* fp) : m_fp(fp)
+		{
+			m_begin = (char*)fp->reserve(MESH_RECORD_MAX);
+			if (!m_begin)
+				m_begin = m_local;
+			m_ptr = m_begin;
+		}
+		~TEXT_RECORD()
+		{
+			if (m_begin == m_local)
+				m_fp->write(m_local, u32(m_ptr - m_begin));
+			else
+				m_fp->commit(u32(m_ptr - m_begin));
+		}
+
+		void put(char c) { *m_ptr++ = c; }
+		void put(const char* str) { while (*str) *m_ptr++ = *str++; }
+		void put(int value) { m_ptr += format_int(m_ptr, value); }
+		void put(float value, int precision) { m_ptr += format_float(m_ptr, value, precision); }
+
+		FILE*	m_fp;
+		char*	m_begin;
+		char*	m_ptr;
+		char	m_local[MESH_RECORD_MAX];
+	};
+
 	void MESH::compact_vertices()
 	{
-		VECTOR<int> remap(m_positions.size());
+		const int num_vertices = m_positions.size();
+		VECTOR<int> remap(num_vertices);
+		remap.resize(num_vertices);
 		remap.fill(0);
 
 		// mark references vertices
@@ -29,18 +75,32 @@ namespace xr
 			remap[m_faces[i].i2] = 1;
 		}
 
+		// the other vertex streams move along with the positions
+		const bool normals = m_normals.size() == num_vertices;
+		const bool uv1 = m_uv1.size() == num_vertices;
+		const bool uv2 = m_uv2.size() == num_vertices;
+		const bool colors = m_colors.size() == num_vertices;
+
 		// compact referenced vertices and compute remap
-		size_t vertex_count = 0;
-		for (size_t i = 0, n = remap.size(); i < n; ++i) {
+		int vertex_count = 0;
+		for (int i = 0; i < num_vertices; ++i) {
 			if (!remap[i]) continue;
 			remap[i] = vertex_count;
 			m_positions[vertex_count] = m_positions[i];
+			if (normals) m_normals[vertex_count] = m_normals[i];
+			if (uv1) m_uv1[vertex_count] = m_uv1[i];
+			if (uv2) m_uv2[vertex_count] = m_uv2[i];
+			if (colors) m_colors[vertex_count] = m_colors[i];
 			vertex_count++;
 		}
 		m_positions.resize(vertex_count);
+		if (normals) m_normals.resize(vertex_count);
+		if (uv1) m_uv1.resize(vertex_count);
+		if (uv2) m_uv2.resize(vertex_count);
+		if (colors) m_colors.resize(vertex_count);
 
 		// remap indices to the compacted vertices
-		for (size_t i = 0, n = m_faces.size(); i < n; ++i) {
+		for (int i = 0, n = m_faces.size(); i < n; ++i) {
 			for (int j = 0; j < 3; ++j)
 			{
 				m_faces[i].i[j] = remap[m_faces[i].i[j]];
@@ -67,53 +127,106 @@ namespace xr
 
 	void MESH::center(Vec3 v)
 	{
-		for (int i = 0; i < m_positions.size(); ++i)
-		{
-			m_positions[i] = m_positions[i] - v;
-		}
+		vec3_translate(m_positions.begin(), m_positions.size(), -v);
 	}
 
 	void MESH::compute_face_normals()
 	{
 		int n = m_faces.size();
 		m_face_normals.resize(n);
-		for (int f = 0; f < n; ++f)
-		{
-			const MESH::FACE& face = m_faces[f];
-			Vec3 v0 = m_positions[face.i0] - m_positions[face.i1];
-			Vec3 v1 = m_positions[face.i0] - m_positions[face.i2];
-			m_face_normals[f] = normalize(cross(v0, v1));
-		}
+		if (n)
+			vec3_face_normals(m_positions.begin(), m_faces[0].i, sizeof(FACE) / sizeof(int), n, m_face_normals.begin());
 	}
 
-	void MESH::compute_vertex_normals()
+	// one pass over the faces: every face normal is stored and added, weighted, to its vertices in one of
+	// up to NORMALS_PARTIAL_MAX per thread sums over a run of the faces, and the sums are reduced per vertex
+	void MESH::compute_vertex_normals(NORMAL_WEIGHTING weighting)
 	{
-		if (m_face_normals.size() != m_faces.size())
-			compute_face_normals();
+		const int num_vertices = m_positions.size(), num_faces = m_faces.size();
+		const Vec3* positions = m_positions.begin();
+		const FACE* faces = m_faces.begin();
+		m_face_normals.resize(num_faces);
+		m_normals.resize(num_vertices);
+		Vec3* face_normals = m_face_normals.begin();
+
+		const int num_partials = Clamp(Min(jobs_num_workers() + 1, num_faces / ADJACENCY_BLOCK), 1, NORMALS_PARTIAL_MAX);
+		VECTOR<Vec3> partials[NORMALS_PARTIAL_MAX - 1];
+		Vec3* sums[NORMALS_PARTIAL_MAX] = { m_normals.begin() };
+		for (int k = 1; k < num_partials; ++k)
+		{
+			partials[k - 1].resize(num_vertices);
+			sums[k] = partials[k - 1].begin();
+		}
 
-		if (m_vertex_faces.size() != m_positions.size())
-			compute_vertex_faces();
+		parallel_for(0, num_partials, 1, [&](int k) {
+			Vec3* sum = sums[k];
+			for (int v = 0; v < num_vertices; ++v)
+				sum[v] = Vec3(0, 0, 0);
 
-		int n = m_positions.size();
-		m_normals.resize(n);
-		for (int i = 0; i < n; ++i)
-		{
-			const VECTOR<int>& vf = m_vertex_faces[i];
-			if (vf.empty())
+			for (int f = (int)((i64)num_faces * k / num_partials), fn = (int)((i64)num_faces * (k + 1) / num_partials); f < fn; ++f)
 			{
-				m_normals[i] = Vec3(0, 0, 0);
-				continue;
+				const FACE& face = faces[f];
+				const Vec3 p[3] = { positions[face.i0], positions[face.i1], positions[face.i2] };
+				const Vec3 n = cross(p[0] - p[1], p[0] - p[2]);
+				face_normals[f] = normalize(n);
+
+				// zero area, which includes every face using a vertex twice
+				if (!(length_sq(n) > 0))
+					continue;
+
+				if (weighting == NORMALS_ANGLE)
+				{
+					// edge j runs from corner j to the next one, the angle at corner j is between edge j and edge j + 2 reversed
+					const Vec3 e[3] = { p[1] - p[0], p[2] - p[1], p[0] - p[2] };
+					const float inv_len[3] = { 1.0f / length(e[0]), 1.0f / length(e[1]), 1.0f / length(e[2]) };
+					for (int j = 0; j < 3; ++j)
+					{
+						const int k = (j + 2) % 3;
+						const float cosine = -dot(e[j], e[k]) * inv_len[j] * inv_len[k];
+						sum[face.i[j]] = sum[face.i[j]] + face_normals[f] * acosf(Clamp(cosine, -1.0f, 1.0f));
+					}
+					continue;
+				}
+
+				const Vec3 weighted = weighting == NORMALS_AREA ? n : face_normals[f];
+				for (int j = 0; j < 3; ++j)
+					sum[face.i[j]] = sum[face.i[j]] + weighted;
 			}
+		});
 
-			Vec3 sum(0, 0, 0);
-			for (int j = 0, jn = vf.size(); j < jn; ++j)
-				sum = sum + m_normals[vf[j]];
-			m_normals[i] = sum * (1.0f / vf.size());
-		}
+		const int vertex_blocks = (num_vertices + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int v = b * ADJACENCY_BLOCK, n = Min(v + ADJACENCY_BLOCK, num_vertices); v < n; ++v)
+			{
+				Vec3 sum = sums[0][v];
+				for (int k = 1; k < num_partials; ++k)
+					sum = sum + sums[k][v];
+				sums[0][v] = length_sq(sum) > 0 ? normalize(sum) : Vec3(0, 0, 0);
+			}
+		});
+	}
+
+	MESH::~MESH()
+	{
+		clear();
 	}
 
 	void MESH::clear()
 	{
+		// streams of a read .xmesh let go of the mapping before it goes away
+		if (m_mapping)
+		{
+			m_positions.reset();
+			m_normals.reset();
+			m_uv1.reset();
+			m_uv2.reset();
+			m_colors.reset();
+			m_faces.reset();
+
+			delete m_mapping;
+			m_mapping = nullptr;
+		}
+
 		m_positions.clear();
 		m_normals.clear();
 		m_uv1.clear();
@@ -124,12 +237,15 @@ namespace xr
 
 		m_face_normals.clear();
 		m_vertex_faces.clear();
+		m_vertex_neighbors.clear();
+		m_opposite_corners.clear();
+		m_vertex_corners.clear();
 		m_materials.clear();
 	}
 
 	bool MESH::write_obj(const char* filename, const char* material_file)
 	{
-		FILE* fp = FILE::open(filename, FILE::WRITE | FILE::TRUNC);
+		FILE* fp = FILE::open(filename, FILE::WRITE | FILE::TRUNC | FILE::ASYNC, MESH_EXPORT_BUFFER_SIZE);
 		if (!fp) {
 			log("ERROR: can not create '%s' file!\n", filename);
 			return false;
@@ -149,13 +265,25 @@ namespace xr
 
 		for (size_t i = 0; i < m_positions.size(); ++i)
 		{
-			fp->printf( "v %.5f %.5f %.5f\n", m_positions[i].x, m_positions[i].y, m_positions[i].z);
+			TEXT_RECORD r(fp);
+			r.put("v ");
+			r.put(m_positions[i].x, 5);
+			r.put(' ');
+			r.put(m_positions[i].y, 5);
+			r.put(' ');
+			r.put(m_positions[i].z, 5);
+			r.put('\n');
 		}
 		if (m_uv1.size())
 		{
 			for (size_t i = 0; i < m_uv1.size(); ++i)
 			{
-				fp->printf("vt %.5f %.5f\n", m_uv1[i].x, m_uv1[i].y);
+				TEXT_RECORD r(fp);
+				r.put("vt ");
+				r.put(m_uv1[i].x, 5);
+				r.put(' ');
+				r.put(m_uv1[i].y, 5);
+				r.put('\n');
 			}
 			face_component |= COMPONENT_UV;
 		}
@@ -163,7 +291,14 @@ namespace xr
 		{
 			for (size_t i = 0; i < m_normals.size(); ++i)
 			{
-				fp->printf("vn %.5f %.5f %.5f\n", m_normals[i].x, m_normals[i].y, m_normals[i].z);
+				TEXT_RECORD r(fp);
+				r.put("vn ");
+				r.put(m_normals[i].x, 5);
+				r.put(' ');
+				r.put(m_normals[i].y, 5);
+				r.put(' ');
+				r.put(m_normals[i].z, 5);
+				r.put('\n');
 			}
 			face_component |= COMPONENT_NORMAL;
 		}
@@ -184,21 +319,25 @@ namespace xr
 					fp->printf("usemtl %s\n", m_materials[f.id].name.c_str());
 			}
 
-			switch (face_component)
+			// p, p/t, p//n or p/t/n per corner, positions, uvs and normals share the index
+			TEXT_RECORD r(fp);
+			r.put('f');
+			for (int j = 0; j < 3; ++j)
 			{
-				case COMPONENT_POS:
-					fp->printf("f %d %d %d\n", f.i0, f.i1, f.i2);
-					break;
-				case COMPONENT_POS | COMPONENT_UV:
-					fp->printf("f %d/%d %d/%d %d/%d\n", f.i0, f.i0, f.i1, f.i1, f.i2, f.i2);
-					break;
-				case COMPONENT_POS | COMPONENT_NORMAL:
-					fp->printf("f %d//%d %d//%d %d//%d\n", f.i0, f.i0, f.i1, f.i1, f.i2, f.i2);
-					break;
-				case COMPONENT_POS | COMPONENT_UV | COMPONENT_NORMAL:
-					fp->printf("f %d/%d/%d %d/%d/%d %d/%d/%d\n", f.i0, f.i0, f.i0, f.i1, f.i1, f.i1, f.i2, f.i2, f.i2);
-					break;
+				r.put(' ');
+				r.put(f.i[j]);
+				if (face_component & COMPONENT_UV)
+				{
+					r.put('/');
+					r.put(f.i[j]);
+				}
+				if (face_component & COMPONENT_NORMAL)
+				{
+					r.put(face_component & COMPONENT_UV ? "/" : "//");
+					r.put(f.i[j]);
+				}
 			}
+			r.put('\n');
 		}
 		delete fp;
 
@@ -208,460 +347,2270 @@ namespace xr
 			{
 				const MATERIAL& m = m_materials[i];
 				if (m.name.empty())
-					fp->printf("newmtl %d\n", i);
+					fp_mtl->printf("newmtl %d\n", i);
 				else
-					fp->printf("newmtl %s\n", m.name.c_str());
-				if (m.ambient != Vec3(1, 1, 1)) fp->printf("Ka %0.2f %0.2f %0.2f\n", m.ambient.x, m.ambient.y, m.ambient.z);
-				if (m.diffuse != Vec3(1, 1, 1)) fp->printf("Kd %0.2f %0.2f %0.2f\n", m.diffuse.x, m.diffuse.y, m.diffuse.z);
-				if (m.specular != Vec3(1, 1, 1)) fp->printf("Ks %0.2f %0.2f %0.2f\n", m.specular.x, m.specular.y, m.specular.z);
+					fp_mtl->printf("newmtl %s\n", m.name.c_str());
+				if (m.ambient != Vec3(1, 1, 1)) fp_mtl->printf("Ka %0.2f %0.2f %0.2f\n", m.ambient.x, m.ambient.y, m.ambient.z);
+				if (m.diffuse != Vec3(1, 1, 1)) fp_mtl->printf("Kd %0.2f %0.2f %0.2f\n", m.diffuse.x, m.diffuse.y, m.diffuse.z);
+				if (m.specular != Vec3(1, 1, 1)) fp_mtl->printf("Ks %0.2f %0.2f %0.2f\n", m.specular.x, m.specular.y, m.specular.z);
 			}
 			delete fp_mtl;
 		}
 		return true;
 	}
 
-	struct FAT_VERTEX
-	{
-		Vec3 pos, normal;
-		Vec2 uv;
+	// OBJ loading runs in three steps: newline aligned chunks are parsed in parallel, relative indices and
+	// the face component masks are resolved once the per chunk counts are known, and the fat vertices
+	// (position, normal, uv) are welded through a shared table where the first corner of a vertex decides
+	// its order, so the result is the same as a serial load
+	#define OBJ_CHUNK_SIZE		(1024 * 1024)
+	#define OBJ_CORNER_BLOCK	(64 * 1024)
+	#define OBJ_INHERIT_MASK	(-1)
 
-		bool operator == (const FAT_VERTEX& rhs) const
-		{
-			return
-				pos.x == rhs.pos.x && pos.y == rhs.pos.y && pos.z == rhs.pos.z &&
-				uv.x == rhs.uv.x && uv.y == rhs.uv.y &&
-				normal.x == rhs.normal.x && normal.y == rhs.normal.y && normal.z == rhs.normal.z;
-		}
+	// a face line of a chunk; the counts are what the chunk had read before it
+	struct OBJ_FACE
+	{
+		int		first_corner;
+		int		num_corners;
+		int		num_positions, num_uvs, num_normals;
+		int		mask;	// OBJ_INHERIT_MASK while it depends on the chunks before
 	};
 
-	u32 hash(const FAT_VERTEX& v)
+	struct OBJ_CHUNK
 	{
-		u32 h = hash(v.pos.x);
-		h = h * 1337 + hash(v.pos.y);
-		h = h * 1337 + hash(v.pos.z);
+		const char*			begin;
+		const char*			end;
+
+		VECTOR<Vec3>		positions;
+		VECTOR<Vec2>		uvs;
+		VECTOR<Vec3>		normals;
+		VECTOR<OBJ_FACE>	faces;
+		VECTOR<int>			corners;	// position, uv and normal index as written, 0 when missing
+
+		int					num_triangles;
+		int					first_format;	// format of the first face that inherits the mask
+		int					end_mask;
+
+		int					base_positions, base_uvs, base_normals;
+		int					base_corners, base_triangles;
+		int					start_mask;
+	};
 
-		h = h * 1337 + hash(v.uv.x);
-		h = h * 1337 + hash(v.uv.y);
+	static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+	static inline bool is_blank(char c) { return c == ' ' || c == '\t'; }
 
-		h = h * 1337 + hash(v.normal.x);
-		h = h * 1337 + hash(v.normal.y);
-		h = h * 1337 + hash(v.normal.z);
+	static const char* skip_blanks(const char* p, const char* end)
+	{
+		while (p < end && is_blank(*p)) ++p;
+		return p;
+	}
 
-		return h;
+	static const char* parse_int(const char* p, const char* end, int& value, bool& ok)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		ok = p < end && is_digit(*p);
+		i64 v = 0;
+		for (; p < end && is_digit(*p); ++p)
+			v = Min<i64>(v * 10 + (*p - '0'), 0x7fffffff);
+		value = int(negative ? -v : v);
+		return p;
 	}
 
-	bool MESH::read_obj(const char* filename)
+	// strtof with the common decimal forms done inline; everything the fast path can't round exactly
+	// (more than 19 digits, large exponents, results on a float halfway point, inf, nan, hex) goes to strtof
+	static const char* parse_float(const char* p, const char* end, float& value)
 	{
-		clear();
+		static const double pow10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
 
-		FILE* fp = FILE::open(filename, FILE::READ );
-		if (!fp) {
-			log("ERROR: can not open '%s' file!\n", filename);
-			return false;
+		p = skip_blanks(p, end);
+		const char* start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		u64 mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false, slow = false;
+
+		for (; p < end && is_digit(*p); ++p, any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+			}
+			else
+				slow = true;
+		}
+		if (p < end && *p == '.')
+		{
+			for (++p; p < end && is_digit(*p); ++p, any = true)
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+				else
+					slow = true;
+			}
+		}
+		if (any && p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* q = p + 1;
+			bool exp_negative = false;
+			if (q < end && (*q == '-' || *q == '+'))
+				exp_negative = *q++ == '-';
+			if (q < end && is_digit(*q))
+			{
+				int e = 0;
+				for (; q < end && is_digit(*q); ++q)
+					e = Min(e * 10 + (*q - '0'), 10000);
+				exponent += exp_negative ? -e : e;
+				p = q;
+			}
+		}
+		if (!any || (p < end && (*p == 'x' || *p == 'X')))
+			slow = true;
+
+		if (!slow)
+		{
+			if (mantissa == 0)
+			{
+				value = negative ? -0.0f : 0.0f;
+				return p;
+			}
+			if (mantissa < (u64(1) << 53) && exponent >= -22 && exponent <= 22)
+			{
+				// one correctly rounded double op, then only a double sitting exactly between two
+				// floats can round differently from the decimal text
+				double d = exponent < 0 ? double(mantissa) / pow10[-exponent] : double(mantissa) * pow10[exponent];
+				float f = float(d);
+				bool halfway = false;
+				if (double(f) != d)
+				{
+					const float other = nextafterf(f, double(f) < d ? INFINITY : -INFINITY);
+					halfway = (double(f) + double(other)) * 0.5 == d;
+				}
+				if (!halfway)
+				{
+					value = negative ? -f : f;
+					return p;
+				}
+			}
 		}
 
-		VECTOR<Vec3> positions;
-		VECTOR<Vec2> uvs;
-		VECTOR<Vec3> normals;
+		char token[128];
+		int len = 0;
+		for (const char* q = start; q < end && !is_blank(*q) && len < int(sizeof(token)) - 1; ++q)
+			token[len++] = *q;
+		token[len] = 0;
+
+		char* token_end;
+		value = strtof(token, &token_end);
+		return start + (token_end - token);
+	}
+
+	static void parse_obj_chunk(OBJ_CHUNK& chunk)
+	{
+		chunk.num_triangles = 0;
+		chunk.first_format = 0;
 
-		HASH_MAP<FAT_VERTEX, int>	v2i;
+		int mask = OBJ_INHERIT_MASK;
 
-		int face_component_mask = 0;  // what compinents we should read from a face indices
+		FILE_LINES lines((const u8*)chunk.begin, chunk.end - chunk.begin);
+		STRING_VIEW line;
 
-		while (!fp->eof())
+		while (lines.next(line))
 		{
-			char line[1024];
-			fp->read_line(line, 1024);
+			const char* p = line.ptr;
+			const char* end = line.ptr + line.len;
 
-			switch (line[0])
+			switch (p[0])
 			{
 				case 'v':
-					face_component_mask = 0;
-					if (line[1] == 't') {
-						float u, v;
-						sscanf_s(line + 3, "%f %f", &u, &v);
-						uvs.push_back(Vec2(u, 1.0f - v));
+					mask = 0;
+					if (line.len > 1 && p[1] == 't') {
+						float u = 0, v = 0;
+						p = parse_float(Min(p + 3, end), end, u);
+						parse_float(p, end, v);
+						chunk.uvs.push_back(Vec2(u, 1.0f - v));
 					}
-					else if (line[1] == 'n') {
-						Vec3 n;
-						sscanf_s(line + 3, "%f %f %f", &n.x, &n.y, &n.z);
-						normals.push_back(n);
+					else if (line.len > 1 && p[1] == 'n') {
+						Vec3 n(0, 0, 0);
+						p = parse_float(Min(p + 3, end), end, n.x);
+						p = parse_float(p, end, n.y);
+						parse_float(p, end, n.z);
+						chunk.normals.push_back(n);
 					}
-					else if (line[1] == ' ') {
-						Vec3 pos;
-						sscanf_s(line + 2, "%f %f %f", &pos.x, &pos.y, &pos.z);
-						positions.push_back(pos);
+					else if (line.len > 1 && p[1] == ' ') {
+						Vec3 pos(0, 0, 0);
+						p = parse_float(p + 2, end, pos.x);
+						p = parse_float(p, end, pos.y);
+						parse_float(p, end, pos.z);
+						chunk.positions.push_back(pos);
 					}
 					break;
 				case 'f':
 				{
-					FACE pf, tf, nf;
-					const char* p = line + 2;
+					OBJ_FACE face;
+					face.first_corner = chunk.corners.size() / 3;
+					face.num_positions = chunk.positions.size();
+					face.num_uvs = chunk.uvs.size();
+					face.num_normals = chunk.normals.size();
+
+					// the components of the first corner decide the format, as in "1", "1/2", "1/2/3" or "1//3"
+					int format = COMPONENT_POS;
+					int count = 0;
 
-					if (!face_component_mask)
+					for (p = skip_blanks(p + 1, end); p < end; p = skip_blanks(p, end), ++count)
 					{
-						face_component_mask = COMPONENT_POS;
-						const char* s1 = strchr(p, '/');
-						const char* next_space = strchr(p, ' ');
-						if (s1 && s1 < next_space)
+						int pi, ui = 0, ni = 0;
+						bool ok;
+						p = parse_int(p, end, pi, ok);
+						if (!ok)
+							break;
+
+						if (p < end && *p == '/')
 						{
-							const char* s2 = strchr(s1 + 1, '/');
-							if (s2 && s2 < next_space)
+							if (++p < end && *p != '/')
 							{
-								if (s2 > s1 + 1)
-									face_component_mask |= COMPONENT_UV;
-								const char* s3 = strchr(s2 + 1, '/');
-								if (s3 > s2 + 1 && s3 < next_space)
-									face_component_mask |= COMPONENT_NORMAL;
+								p = parse_int(p, end, ui, ok);
+								if (ok && !count) format |= COMPONENT_UV;
+							}
+							if (p < end && *p == '/')
+							{
+								p = parse_int(p + 1, end, ni, ok);
+								if (ok && !count) format |= COMPONENT_NORMAL;
 							}
 						}
+						chunk.corners.push_back(pi);
+						chunk.corners.push_back(ui);
+						chunk.corners.push_back(ni);
+
+						while (p < end && !is_blank(*p)) ++p;
 					}
 
-					FACE face;
+					if (mask == 0)
+						mask = format;
+					else if (mask == OBJ_INHERIT_MASK && !chunk.first_format)
+						chunk.first_format = format;
 
-					for (int index = 0; p; ++index )
+					if (count < 3)
 					{
-						int pi, ni, ui;
-
-						switch (face_component_mask)
-						{
-							case COMPONENT_POS:
-								sscanf_s(p, "%d", &pi); break;
-							case COMPONENT_POS + COMPONENT_UV:
-								sscanf_s(p, "%d/%d", &pi, &ui); break;
-							case COMPONENT_POS + COMPONENT_UV + COMPONENT_NORMAL:
-								sscanf_s(p, "%d/%d/%d", &pi, &ui, &ni); break;
-							case COMPONENT_POS + COMPONENT_NORMAL:
-								sscanf_s(p, "%d//%d", &pi, &ni); break;
-						}
-
-						pi += (pi > 0) ? -1 : positions.size();
-						if (face_component_mask & COMPONENT_UV) ui += (ui > 0) ? -1 : uvs.size();
-						if (face_component_mask & COMPONENT_NORMAL) ni += (ni > 0) ? -1 : normals.size();
-
-						FAT_VERTEX fv;
-						fv.pos = positions[pi];
-						fv.normal = normals.empty() ? Vec3(0,0,0) : normals[ni];
-						fv.uv = uvs.empty() ? Vec2(0,0) : uvs[ui];
-
-						int vi;
-						if (!v2i.find(fv, vi))
-						{
-							vi = m_positions.size();
-							m_positions.push_back(fv.pos);
-							if(normals.size()) m_normals.push_back(fv.normal);
-							if(uvs.size()) m_uv1.push_back(fv.uv);
-							v2i.insert(fv, vi);
-						}
-
-						// produce triangles from a fan - cycle 2 -> 1 and add to the 2nd index
-						if (index <= 2)
-						{
-							face.i[index] = vi;
-						}
-						else
-						{
-							face.i[1] = face.i[2];
-							face.i[2] = vi;
-						}
-						if (index >= 2) m_faces.push_back(face);
-
-						p = strchr(p + 1, ' ');
-						if (!p)
-							break;
+						chunk.corners.resize(face.first_corner * 3);
+						break;
 					}
+					face.num_corners = count;
+					face.mask = mask;
+					chunk.faces.push_back(face);
+					chunk.num_triangles += count - 2;
 					break;
 				}
 			}
 		}
-
-		delete fp;
-		return true;
+		chunk.end_mask = mask;
 	}
 
-	bool MESH::write_ply(const char* file)
+	// OBJ indices are 1 based, negative ones count back from the last element read; -1 when missing
+	static inline int resolve_obj_index(int index, int num_read, int num_total, bool& valid)
 	{
-		FILE* fp = FILE::open(file, FILE::WRITE);
-		if (!fp) {
-			log("ERROR: can not open '%s' file!\n", file);
-			return false;
-		}
-
-		fp->printf("ply\nformat ascii 1.0\n");
-		fp->printf("element vertex %d\n", m_positions.size());
-		fp->printf("property float32 x\nproperty float32 y\nproperty float32 z\n");
-		if (m_normals.size())
-			fp->printf("property float32 normalx\nproperty float32 normaly\nproperty float32 normalz\n");
-		if(m_uv1.size())
-			fp->printf("property float32 u\nproperty float32 v\n");
-
-		bool colors_alpha = false;
-		if (m_colors.size())
+		if (!index)
+			return -1;
+		index += (index > 0) ? -1 : num_read;
+		if (index < 0 || index >= num_total)
 		{
-			float prev = m_colors[0].w;
-			fp->printf("property uchar red\nproperty uchar green\nproperty uchar blue\n");
-			for( int i=1; i<m_colors.size(); ++i )
-				if (m_colors[i].w != prev) {
-					colors_alpha = true;
-					break;
-				}
-			if (prev != 0.0f && prev != 1.0f)
-				colors_alpha = true;
+			valid = false;
+			return -1;
 		}
-		fp->printf("element face %d\n", m_faces.size());
-		fp->printf("property list uint8 int32 vertex_indices\n");
-		fp->printf("end_header\n");
+		return index;
+	}
 
-		for (int i = 0; i < m_positions.size(); ++i)
-		{
-			fp->printf("%.6f %.6f %.6f", m_positions[i].x, m_positions[i].y, m_positions[i].z);
-			if (m_normals.size())
-				fp->printf(" %.6f %.6f %.6f", m_normals[i].x, m_normals[i].y, m_normals[i].z);
-			if (m_uv1.size())
-				fp->printf(" %.4f %.4f", m_uv1[i].x, m_uv1[i].y);
-			if (m_colors.size())
-			{
-				fp->printf(" %d %d %d", u32(m_colors[i].x * 255.0f), u32(m_colors[i].y*255.0f), u32(m_colors[i].z*255.0f));
-				//if (colors_alpha) fp->printf(" %d", u32(m_colors[i].w * 255.0f));
-			}
-			fp->printf("\n");
-		}
-		for (int i = 0; i < m_faces.size(); ++i)
+	static u32 hash_obj_vertex(const float* key)
+	{
+		u64 h = 0xcbf29ce484222325ull;
+		for (int i = 0; i < 8; ++i)
 		{
-			fp->printf("3 %d %d %d\n", m_faces[i].i0, m_faces[i].i1, m_faces[i].i2);
+			u32 bits;
+			memcpy(&bits, key + i, sizeof(bits));
+			h = (h ^ bits) * 0x100000001b3ull;
 		}
-		delete fp;
-
-		return true;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		return u32(h);
 	}
 
-	bool MESH::read_ply(const char* file)
+	bool MESH::read_obj(const char* filename)
 	{
 		clear();
 
-		FILE* fp = FILE::open(file, FILE::READ);
+		FILE* fp = FILE::open(filename, FILE::READ | FILE::MMAP);
 		if (!fp) {
-			log("ERROR: can not open '%s' file!\n", file);
+			log("ERROR: can not open '%s' file!\n", filename);
 			return false;
 		}
 
-		enum EPROPERTY
-		{
-			PROP_POS_X,
-			PROP_POS_Y,
-			PROP_POS_Z,
-			PROP_NORM_X,
-			PROP_NORM_Y,
-			PROP_NORM_Z,
-			PROP_COLOR_R,
-			PROP_COLOR_G,
-			PROP_COLOR_B,
-			PROP_COLOR_A
-		};
+		const char* data = (const char*)fp->data();
+		const u64 size = fp->size();
 
-		auto read_float = [](const char* str, float& f) -> const char*
+		// chunks start right after a newline
+		int num_chunks = int((size + OBJ_CHUNK_SIZE - 1) / OBJ_CHUNK_SIZE);
+		OBJ_CHUNK* chunks = new OBJ_CHUNK[Max(num_chunks, 1)];
 		{
-			f = atof(str);
-			str = strchr(str, ' ');
-			if (str) str++;
-			return str;
-		};
+			const char* begin = data;
+			const char* end = data + size;
+			int n = 0;
+			for (int i = 0; i < num_chunks && begin < end; ++i, ++n)
+			{
+				const char* split = Min(begin + OBJ_CHUNK_SIZE, end);
+				const char* newline = split < end ? (const char*)memchr(split, '\n', end - split) : nullptr;
+				split = newline ? newline + 1 : end;
 
-		auto read_uchar = [](const char* str, float& u) -> const char*
-		{
-			u8 uc = atoi(str);
-			str = strchr(str, ' ');
-			if (str) str++;
-			u = float(uc) / 255.0f;
-			return str;
-		};
+				chunks[n].begin = begin;
+				chunks[n].end = split;
+				begin = split;
+			}
+			num_chunks = n;
+		}
+
+		parallel_for(0, num_chunks, 1, [chunks](int i) { parse_obj_chunk(chunks[i]); });
 
-		auto read_int = [](const char* str, int& i) -> const char*
+		// resolve the chunk bases and the component mask each chunk starts with
+		int num_positions = 0, num_uvs = 0, num_normals = 0, num_corners = 0, num_triangles = 0;
+		int first_uv_corner = -1, first_normal_corner = -1;	// first corner read after a uv/normal
+		int mask = 0;
+
+		for (int i = 0; i < num_chunks; ++i)
 		{
-			i = atoi(str);
-			str = strchr(str, ' ');
-			if (str) str++;
-			return str;
-		};
+			OBJ_CHUNK& c = chunks[i];
+			c.base_positions = num_positions;
+			c.base_uvs = num_uvs;
+			c.base_normals = num_normals;
+			c.base_corners = num_corners;
+			c.base_triangles = num_triangles;
+			c.start_mask = mask ? mask : c.first_format;
+
+			for (int j = 0, n = c.faces.size(); j < n && (first_uv_corner < 0 || first_normal_corner < 0); ++j)
+			{
+				if (first_uv_corner < 0 && num_uvs + c.faces[j].num_uvs)
+					first_uv_corner = num_corners + c.faces[j].first_corner;
+				if (first_normal_corner < 0 && num_normals + c.faces[j].num_normals)
+					first_normal_corner = num_corners + c.faces[j].first_corner;
+			}
 
-		struct {
-			const char* key;
-			EPROPERTY prop;
-		} rules[] = {
-			{ "float32 x", PROP_POS_X },
-			{ "float32 y", PROP_POS_Y },
-			{ "float32 z", PROP_POS_Z },
-
-			{ "uchar red", PROP_COLOR_R},
-			{ "uchar green", PROP_COLOR_G},
-			{ "uchar blue", PROP_COLOR_B},
-			{ "uchar alpha", PROP_COLOR_A},
-		};
+			mask = c.end_mask == OBJ_INHERIT_MASK ? c.start_mask : c.end_mask;
 
-		EPROPERTY props[32];
-		int props_count = 0;
+			num_positions += c.positions.size();
+			num_uvs += c.uvs.size();
+			num_normals += c.normals.size();
+			num_corners += c.corners.size() / 3;
+			num_triangles += c.num_triangles;
+		}
+		if (first_uv_corner < 0) first_uv_corner = num_corners;
+		if (first_normal_corner < 0) first_normal_corner = num_corners;
+
+		VECTOR<Vec3> positions(num_positions);
+		VECTOR<Vec2> uvs(num_uvs);
+		VECTOR<Vec3> normals(num_normals);
+		positions.resize(num_positions);
+		uvs.resize(num_uvs);
+		normals.resize(num_normals);
+
+		// absolute position, uv and normal index of every corner
+		VECTOR<int> resolved(num_corners * 3);
+		resolved.resize(num_corners * 3);
+
+		std::atomic<bool> valid(true);
+
+		parallel_for(0, num_chunks, 1, [&](int i) {
+			OBJ_CHUNK& c = chunks[i];
+			for (int j = 0, n = c.positions.size(); j < n; ++j)
+				positions[c.base_positions + j] = c.positions[j];
+			if (c.uvs.size()) memcpy(&uvs[c.base_uvs], c.uvs.begin(), c.uvs.size() * sizeof(Vec2));
+			for (int j = 0, n = c.normals.size(); j < n; ++j)
+				normals[c.base_normals + j] = c.normals[j];
+
+			bool chunk_valid = true;
+			for (int j = 0, n = c.faces.size(); j < n; ++j)
+			{
+				const OBJ_FACE& face = c.faces[j];
+				const int face_mask = face.mask == OBJ_INHERIT_MASK ? c.start_mask : face.mask;
+				const int read_positions = c.base_positions + face.num_positions;
+				const int read_uvs = c.base_uvs + face.num_uvs;
+				const int read_normals = c.base_normals + face.num_normals;
+
+				const int* src = &c.corners[face.first_corner * 3];
+				int* dst = &resolved[(c.base_corners + face.first_corner) * 3];
+				for (int k = 0; k < face.num_corners; ++k, src += 3, dst += 3)
+				{
+					dst[0] = resolve_obj_index(src[0], read_positions, num_positions, chunk_valid);
+					if (dst[0] < 0)
+						chunk_valid = false;
+					dst[1] = (face_mask & COMPONENT_UV) && read_uvs ? resolve_obj_index(src[1], read_uvs, num_uvs, chunk_valid) : -1;
+					dst[2] = (face_mask & COMPONENT_NORMAL) && read_normals ? resolve_obj_index(src[2], read_normals, num_normals, chunk_valid) : -1;
+				}
+			}
+			if (!chunk_valid)
+				valid = false;
+		});
 
-		auto check_prefix = [](const char* &str, const char* prefix) -> bool
+		if (!valid)
 		{
-			int len = strlen(prefix);
-			if (strncmp(str, prefix, len)) return false;
+			log("ERROR: invalid face index in '%s' file!\n", filename);
+			delete[] chunks;
+			delete fp;
+			return false;
+		}
 
-			str += len;
-			return true;
+		auto vertex_key = [&](int corner, float* key) {
+			const int* r = &resolved[corner * 3];
+			const Vec3 n = r[2] >= 0 ? normals[r[2]] : Vec3(0, 0, 0);
+			const Vec2 uv = r[1] >= 0 ? uvs[r[1]] : Vec2(0, 0);
+			memcpy(key, &positions[r[0]], sizeof(Vec3));
+			memcpy(key + 3, &n, sizeof(Vec3));
+			memcpy(key + 6, &uv, sizeof(Vec2));
 		};
 
-		int num_vertices = 0;
+		// weld: every corner finds or claims the slot of its fat vertex, the slot keeps the smallest corner
+		u32 table_size = 64;
+		while (table_size < u32(num_corners) * 2)
+			table_size *= 2;
+		const u32 table_mask = table_size - 1;
 
-		while (!fp->eof())
-		{
-			char line[1024];
-			fp->read_line(line, 1024);
+		std::atomic<u32>* slot_owner = new std::atomic<u32>[table_size];	// claiming corner + 1, 0 when empty
+		std::atomic<u32>* slot_first = new std::atomic<u32>[table_size];	// smallest corner of the vertex
+		VECTOR<int> corner_slot(num_corners);
+		VECTOR<int> corner_rank(num_corners);	// unique vertices first seen before the corner
+		corner_slot.resize(num_corners);
+		corner_rank.resize(num_corners);
 
-			const char* ptr = line;
+		const int num_blocks = (num_corners + OBJ_CORNER_BLOCK - 1) / OBJ_CORNER_BLOCK;
+		const int table_blocks = int((table_size + OBJ_CORNER_BLOCK - 1) / OBJ_CORNER_BLOCK);
 
-			if (check_prefix(ptr, "element vertex "))
-			{
-				num_vertices = atoi(ptr);
-				m_positions.resize(num_vertices);
-			}
-			else if (check_prefix(ptr, "element face "))
+		parallel_for(0, table_blocks, 1, [&](int b) {
+			for (u32 i = u32(b) * OBJ_CORNER_BLOCK, n = Min<u32>(i + OBJ_CORNER_BLOCK, table_size); i < n; ++i)
 			{
-				m_faces.resize(atoi(ptr));
+				slot_owner[i].store(0, std::memory_order_relaxed);
+				slot_first[i].store(0xffffffff, std::memory_order_relaxed);
 			}
-			else if (check_prefix(ptr, "property "))
+		});
+
+		parallel_for(0, num_blocks, 1, [&](int b) {
+			float key[8], other[8];
+			for (int i = b * OBJ_CORNER_BLOCK, n = Min(i + OBJ_CORNER_BLOCK, num_corners); i < n; ++i)
 			{
-				for (int i = 0; i < sizeof(rules) / sizeof(rules[0]); ++i)
+				vertex_key(i, key);
+				u32 slot = hash_obj_vertex(key) & table_mask;
+				for (;;)
 				{
-					if (!strncmp(ptr, rules[i].key, strlen(rules[i].key)))
-					{
-						props[props_count++] = rules[i].prop;
-
-						switch (rules[i].prop)
-						{
-						case PROP_POS_X:
-						case PROP_POS_Y:
-						case PROP_POS_Z:
-							m_positions.resize(num_vertices);
-							break;
-
-						case PROP_COLOR_R:
-						case PROP_COLOR_G:
-						case PROP_COLOR_B:
-						case PROP_COLOR_A:
-							m_colors.resize(num_vertices);
-							break;
+					u32 owner = slot_owner[slot].load(std::memory_order_acquire);
+					if (!owner && slot_owner[slot].compare_exchange_strong(owner, u32(i) + 1, std::memory_order_acq_rel))
+						break;
 
-						case PROP_NORM_X:
-						case PROP_NORM_Y:
-						case PROP_NORM_Z:
-							m_normals.resize(num_vertices);
-							break;
-						}
+					vertex_key(int(owner - 1), other);
+					if (!memcmp(key, other, sizeof(key)))
 						break;
-					}
+					slot = (slot + 1) & table_mask;
 				}
+
+				u32 first = slot_first[slot].load(std::memory_order_relaxed);
+				while (u32(i) < first && !slot_first[slot].compare_exchange_weak(first, u32(i), std::memory_order_relaxed))
+					;
+				corner_slot[i] = int(slot);
 			}
-			else if (check_prefix(ptr, "end_header"))
-			{
-				for (int i = 0; i < num_vertices; ++i)
-				{
-					fp->read_line(line, 1024);
-					const char* ptr = line;
+		});
 
-					for (int j = 0; j < props_count; ++j)
-					{
-						switch (props[j])
-						{
-							case PROP_POS_X:
-								ptr = read_float(ptr, m_positions[i].x);
-								break;
-							case PROP_POS_Y:
-								ptr = read_float(ptr, m_positions[i].y);
-								break;
-							case PROP_POS_Z:
-								ptr = read_float(ptr, m_positions[i].z);
-								break;
+		// number the vertices in the order of their first corners
+		VECTOR<int> block_vertices(Max(num_blocks, 1));
+		block_vertices.resize(num_blocks);
 
-							case PROP_COLOR_R:
-								ptr = read_uchar(ptr, m_colors[i].x);
-								break;
-							case PROP_COLOR_G:
-								ptr = read_uchar(ptr, m_colors[i].y);
-								break;
-							case PROP_COLOR_B:
-								ptr = read_uchar(ptr, m_colors[i].z);
-								break;
-							case PROP_COLOR_A:
-								ptr = read_uchar(ptr, m_colors[i].w);
-								break;
-						}
-					}
-				}
-				for (int i = 0, num_faces = m_faces.size(); i < num_faces; ++i)
-				{
-					fp->read_line(line, 1024);
-					const char* ptr = line;
+		parallel_for(0, num_blocks, 1, [&](int b) {
+			int count = 0;
+			for (int i = b * OBJ_CORNER_BLOCK, n = Min(i + OBJ_CORNER_BLOCK, num_corners); i < n; ++i)
+				count += slot_first[corner_slot[i]].load(std::memory_order_relaxed) == u32(i);
+			block_vertices[b] = count;
+		});
 
-					int count;
-					ptr = read_int(ptr, count);
+		int num_vertices = 0;
+		for (int b = 0; b < num_blocks; ++b)
+		{
+			const int count = block_vertices[b];
+			block_vertices[b] = num_vertices;
+			num_vertices += count;
+		}
 
-					ptr = read_int(ptr, m_faces[i].i0);
-					ptr = read_int(ptr, m_faces[i].i1);
-					ptr = read_int(ptr, m_faces[i].i2);
-				}
+		parallel_for(0, num_blocks, 1, [&](int b) {
+			int rank = block_vertices[b];
+			for (int i = b * OBJ_CORNER_BLOCK, n = Min(i + OBJ_CORNER_BLOCK, num_corners); i < n; ++i)
+			{
+				corner_rank[i] = rank;
+				rank += slot_first[corner_slot[i]].load(std::memory_order_relaxed) == u32(i);
 			}
-		}
-	}
+		});
 
-	void MESH::compute_vertex_faces()
-	{
-		m_vertex_faces.clear();
-		m_vertex_faces.resize(m_positions.size());
+		// uvs and normals are only stored once the file had any when the vertex was first seen
+		const int first_uv_vertex = first_uv_corner < num_corners ? corner_rank[first_uv_corner] : num_vertices;
+		const int first_normal_vertex = first_normal_corner < num_corners ? corner_rank[first_normal_corner] : num_vertices;
 
-		for (int i = 0, n = m_faces.size(); i < n; ++i)
-		{
-			for (int j = 0; j < 3; ++j)
+		m_positions.resize(num_vertices);
+		m_uv1.resize(num_vertices - first_uv_vertex);
+		m_normals.resize(num_vertices - first_normal_vertex);
+
+		parallel_for(0, num_blocks, 1, [&](int b) {
+			for (int i = b * OBJ_CORNER_BLOCK, n = Min(i + OBJ_CORNER_BLOCK, num_corners); i < n; ++i)
 			{
-				int vertex = m_faces[i].i[j];
+				const u32 first = slot_first[corner_slot[i]].load(std::memory_order_relaxed);
+				if (first == u32(i))
+				{
+					const int vi = corner_rank[i];
+					const int* r = &resolved[i * 3];
+					m_positions[vi] = positions[r[0]];
+					if (vi >= first_uv_vertex) m_uv1[vi - first_uv_vertex] = r[1] >= 0 ? uvs[r[1]] : Vec2(0, 0);
+					if (vi >= first_normal_vertex) m_normals[vi - first_normal_vertex] = r[2] >= 0 ? normals[r[2]] : Vec3(0, 0, 0);
+				}
+			}
+		});
 
-				auto& vec = m_vertex_faces[vertex];
+		parallel_for(0, num_blocks, 1, [&](int b) {
+			for (int i = b * OBJ_CORNER_BLOCK, n = Min(i + OBJ_CORNER_BLOCK, num_corners); i < n; ++i)
+				corner_slot[i] = corner_rank[slot_first[corner_slot[i]].load(std::memory_order_relaxed)];
+		});
 
-				int k = 0;
-				for (int kn = vec.size(); k < kn; ++k)
-					if (vec[k] == i) break;
+		// triangulate the faces as fans around their first corner
+		m_faces.resize(num_triangles);
 
-				if (k == vec.size())
-					vec.push_back(i);
+		parallel_for(0, num_chunks, 1, [&](int i) {
+			const OBJ_CHUNK& c = chunks[i];
+			FACE* dst = m_faces.begin() + c.base_triangles;
+			for (int j = 0, n = c.faces.size(); j < n; ++j)
+			{
+				const int* v = &corner_slot[c.base_corners + c.faces[j].first_corner];
+				for (int k = 2; k < c.faces[j].num_corners; ++k, ++dst)
+				{
+					*dst = FACE(v[0], v[k - 1], v[k]);
+					dst->id = 0;
+				}
 			}
-		}
+		});
+
+		delete[] slot_owner;
+		delete[] slot_first;
+		delete[] chunks;
+		delete fp;
+		return true;
 	}
 
-	void MESH::compute_vertex_neighbors()
+	// PLY property types, both spellings of the spec are accepted
+	enum PLY_TYPE
 	{
-		m_vertex_neighbors.clear();
-		m_vertex_neighbors.resize(m_positions.size());
+		PLY_INT8,
+		PLY_UINT8,
+		PLY_INT16,
+		PLY_UINT16,
+		PLY_INT32,
+		PLY_UINT32,
+		PLY_FLOAT32,
+		PLY_FLOAT64,
+		PLY_NONE
+	};
+
+	static const struct {
+		const char*	name;
+		const char*	alias;
+		int			size;
+	} s_ply_types[] = {
+		{ "int8", "char", 1 },
+		{ "uint8", "uchar", 1 },
+		{ "int16", "short", 2 },
+		{ "uint16", "ushort", 2 },
+		{ "int32", "int", 4 },
+		{ "uint32", "uint", 4 },
+		{ "float32", "float", 4 },
+		{ "float64", "double", 8 },
+	};
+
+	enum
+	{
+		PLY_POSITION,
+		PLY_NORMAL,
+		PLY_UV,
+		PLY_COLOR
+	};
+
+	// vertex properties that have a place in the mesh
+	static const struct {
+		const char*	name;
+		int			stream;
+		int			component;
+	} s_ply_vertex_properties[] = {
+		{ "x", PLY_POSITION, 0 }, { "y", PLY_POSITION, 1 }, { "z", PLY_POSITION, 2 },
+		{ "nx", PLY_NORMAL, 0 }, { "ny", PLY_NORMAL, 1 }, { "nz", PLY_NORMAL, 2 },
+		{ "normalx", PLY_NORMAL, 0 }, { "normaly", PLY_NORMAL, 1 }, { "normalz", PLY_NORMAL, 2 },
+		{ "u", PLY_UV, 0 }, { "v", PLY_UV, 1 }, { "s", PLY_UV, 0 }, { "t", PLY_UV, 1 },
+		{ "texture_u", PLY_UV, 0 }, { "texture_v", PLY_UV, 1 },
+		{ "red", PLY_COLOR, 0 }, { "green", PLY_COLOR, 1 }, { "blue", PLY_COLOR, 2 }, { "alpha", PLY_COLOR, 3 },
+		{ "diffuse_red", PLY_COLOR, 0 }, { "diffuse_green", PLY_COLOR, 1 }, { "diffuse_blue", PLY_COLOR, 2 },
+	};
+
+	#define PLY_MAX_ELEMENTS	8
+	#define PLY_MAX_PROPERTIES	32
+	#define PLY_NAME_MAX		32
+	#define PLY_BLOCK			4096	// records per pass of the bulk decoders and the binary writer
+
+	struct PLY_PROPERTY
+	{
+		char		name[PLY_NAME_MAX];
+		PLY_TYPE	type;		// type of the items for a list
+		PLY_TYPE	count_type;	// PLY_NONE unless it's a list
+		int			offset;		// within the record, when the records have a fixed size
+	};
+
+	struct PLY_ELEMENT
+	{
+		char			name[PLY_NAME_MAX];
+		int				count;
+		int				record_size;	// 0 when a list makes the records variable sized
+		int				num_properties;
+		PLY_PROPERTY	properties[PLY_MAX_PROPERTIES];
+	};
+
+	// where a vertex property goes: base[record * stride] = value / divisor
+	struct PLY_TARGET
+	{
+		float*	base;
+		int		stride;
+		float	divisor;
+	};
+
+	static inline bool is_little_endian_host()
+	{
+		const u16 one = 1;
+		u8 first;
+		memcpy(&first, &one, 1);
+		return first == 1;
+	}
+
+	template< class T > static inline T load_ply(const u8* src, bool swap)
+	{
+		u8 bytes[sizeof(T)];
+		for (int i = 0; i < int(sizeof(T)); ++i)
+			bytes[i] = src[swap ? sizeof(T) - 1 - i : i];
+		T value;
+		memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+
+	template< class T > static inline u8* store_ply(u8* dst, T value, bool swap)
+	{
+		u8 bytes[sizeof(T)];
+		memcpy(bytes, &value, sizeof(T));
+		for (int i = 0; i < int(sizeof(T)); ++i)
+			dst[i] = bytes[swap ? sizeof(T) - 1 - i : i];
+		return dst + sizeof(T);
+	}
+
+	static double load_ply_value(const u8* src, PLY_TYPE type, bool swap)
+	{
+		switch (type)
+		{
+			case PLY_INT8: return *(const i8*)src;
+			case PLY_UINT8: return *src;
+			case PLY_INT16: return load_ply<i16>(src, swap);
+			case PLY_UINT16: return load_ply<u16>(src, swap);
+			case PLY_INT32: return load_ply<i32>(src, swap);
+			case PLY_UINT32: return load_ply<u32>(src, swap);
+			case PLY_FLOAT32: return load_ply<float>(src, swap);
+			case PLY_FLOAT64: return load_ply<double>(src, swap);
+			default: return 0;
+		}
+	}
+
+	template< class T > static void decode_ply_column(const u8* src, int stride, int count, bool swap, const PLY_TARGET& target, int first)
+	{
+		float* dst = target.base + first * target.stride;
+		for (int i = 0; i < count; ++i, src += stride, dst += target.stride)
+			*dst = float(load_ply<T>(src, swap)) / target.divisor;
+	}
+
+	// one property of a block of fixed size records, with the type switch out of the loop
+	static void decode_ply_column(const u8* src, int stride, int count, bool swap, PLY_TYPE type, const PLY_TARGET& target, int first)
+	{
+		switch (type)
+		{
+			case PLY_INT8: decode_ply_column<i8>(src, stride, count, false, target, first); break;
+			case PLY_UINT8: decode_ply_column<u8>(src, stride, count, false, target, first); break;
+			case PLY_INT16: decode_ply_column<i16>(src, stride, count, swap, target, first); break;
+			case PLY_UINT16: decode_ply_column<u16>(src, stride, count, swap, target, first); break;
+			case PLY_INT32: decode_ply_column<i32>(src, stride, count, swap, target, first); break;
+			case PLY_UINT32: decode_ply_column<u32>(src, stride, count, swap, target, first); break;
+			case PLY_FLOAT32: decode_ply_column<float>(src, stride, count, swap, target, first); break;
+			case PLY_FLOAT64: decode_ply_column<double>(src, stride, count, swap, target, first); break;
+			default: break;
+		}
+	}
+
+	struct PLY_BINARY_READER
+	{
+		const u8*	ptr;
+		const u8*	end;
+		bool		swap;
+
+		bool scalar(PLY_TYPE type, float& value)
+		{
+			if (end - ptr < s_ply_types[type].size)
+				return false;
+			value = float(load_ply_value(ptr, type, swap));
+			ptr += s_ply_types[type].size;
+			return true;
+		}
+		bool index(PLY_TYPE type, int& value)
+		{
+			if (end - ptr < s_ply_types[type].size)
+				return false;
+			value = int(load_ply_value(ptr, type, swap));
+			ptr += s_ply_types[type].size;
+			return true;
+		}
+	};
+
+	struct PLY_TEXT_READER
+	{
+		const char*	ptr;
+		const char*	end;
+
+		void skip_space()
+		{
+			while (ptr < end && (is_blank(*ptr) || *ptr == '\r' || *ptr == '\n'))
+				++ptr;
+		}
+		bool scalar(PLY_TYPE, float& value)
+		{
+			skip_space();
+			if (ptr == end)
+				return false;
+			const char* next = parse_float(ptr, end, value);
+			if (next == ptr)
+				return false;
+			ptr = next;
+			return true;
+		}
+		bool index(PLY_TYPE, int& value)
+		{
+			skip_space();
+			bool ok;
+			ptr = parse_int(ptr, end, value, ok);
+			return ok;
+		}
+	};
+
+	// reads records one property at a time; 'targets' has a slot per property, 'face_list' is the index
+	// of the vertex index list, whose polygons are added to 'faces' as fans
+	template< class READER > static bool read_ply_records(READER& reader, const PLY_ELEMENT& element, const PLY_TARGET* targets,
+		int face_list, int num_vertices, VECTOR<MESH::FACE>& faces)
+	{
+		for (int i = 0; i < element.count; ++i)
+		{
+			for (int j = 0; j < element.num_properties; ++j)
+			{
+				const PLY_PROPERTY& prop = element.properties[j];
+				if (prop.count_type == PLY_NONE)
+				{
+					float value;
+					if (!reader.scalar(prop.type, value))
+						return false;
+					if (targets[j].base)
+						targets[j].base[i * targets[j].stride] = value / targets[j].divisor;
+					continue;
+				}
+
+				int count;
+				if (!reader.index(prop.count_type, count) || count < 0)
+					return false;
+
+				MESH::FACE face;
+				face.id = 0;
+				for (int k = 0; k < count; ++k)
+				{
+					int vi;
+					if (!reader.index(prop.type, vi))
+						return false;
+					if (j != face_list)
+						continue;
+					if (vi < 0 || vi >= num_vertices)
+						return false;
+
+					if (k <= 2)
+						face.i[k] = vi;
+					else
+					{
+						face.i[1] = face.i[2];
+						face.i[2] = vi;
+					}
+					if (k >= 2) faces.push_back(face);
+				}
+			}
+		}
+		return true;
+	}
+
+	// the usual face layout: a uint8 count followed by 32 bit indices and nothing else
+	static bool read_ply_faces(PLY_BINARY_READER& reader, const PLY_ELEMENT& element, int num_vertices, VECTOR<MESH::FACE>& faces)
+	{
+		for (int i = 0; i < element.count; ++i)
+		{
+			if (reader.ptr == reader.end)
+				return false;
+			const int count = *reader.ptr++;
+			if (reader.end - reader.ptr < count * 4)
+				return false;
+
+			MESH::FACE face;
+			face.id = 0;
+			for (int k = 0; k < count; ++k, reader.ptr += 4)
+			{
+				const u32 vi = load_ply<u32>(reader.ptr, reader.swap);
+				if (vi >= u32(num_vertices))
+					return false;
+
+				if (k <= 2)
+					face.i[k] = int(vi);
+				else
+				{
+					face.i[1] = face.i[2];
+					face.i[2] = int(vi);
+				}
+				if (k >= 2) faces.push_back(face);
+			}
+		}
+		return true;
+	}
+
+	static PLY_TYPE find_ply_type(const char* name)
+	{
+		for (int i = 0; i < PLY_NONE; ++i)
+		{
+			if (!strcmp(name, s_ply_types[i].name) || !strcmp(name, s_ply_types[i].alias))
+				return PLY_TYPE(i);
+		}
+		return PLY_NONE;
+	}
+
+	// next blank separated word of a header line
+	static bool next_word(const char*& p, const char* end, char* word)
+	{
+		p = skip_blanks(p, end);
+		if (p == end)
+			return false;
+
+		int len = 0;
+		for (; p < end && !is_blank(*p); ++p)
+		{
+			if (len < PLY_NAME_MAX - 1)
+				word[len++] = *p;
+		}
+		word[len] = 0;
+		return true;
+	}
+
+	bool MESH::write_ply(const char* file, PLY_FORMAT format)
+	{
+		FILE* fp = FILE::open(file, FILE::WRITE | FILE::TRUNC | FILE::ASYNC, MESH_EXPORT_BUFFER_SIZE);
+		if (!fp) {
+			log("ERROR: can not open '%s' file!\n", file);
+			return false;
+		}
+
+		static const char* format_names[] = { "ascii", "binary_little_endian", "binary_big_endian" };
+
+		fp->printf("ply\nformat %s 1.0\n", format_names[format]);
+		fp->printf("element vertex %d\n", m_positions.size());
+		fp->printf("property float32 x\nproperty float32 y\nproperty float32 z\n");
+		if (m_normals.size())
+			fp->printf("property float32 normalx\nproperty float32 normaly\nproperty float32 normalz\n");
+		if(m_uv1.size())
+			fp->printf("property float32 u\nproperty float32 v\n");
+
+		bool colors_alpha = false;
+		if (m_colors.size())
+		{
+			float prev = m_colors[0].w;
+			fp->printf("property uchar red\nproperty uchar green\nproperty uchar blue\n");
+			for( int i=1; i<m_colors.size(); ++i )
+				if (m_colors[i].w != prev) {
+					colors_alpha = true;
+					break;
+				}
+			if (prev != 0.0f && prev != 1.0f)
+				colors_alpha = true;
+		}
+		fp->printf("element face %d\n", m_faces.size());
+		fp->printf("property list uint8 int32 vertex_indices\n");
+		fp->printf("end_header\n");
+
+		if (format != PLY_ASCII)
+		{
+			const bool swap = (format == PLY_BINARY_LITTLE_ENDIAN) != is_little_endian_host();
+			const int vertex_size = 12 + (m_normals.size() ? 12 : 0) + (m_uv1.size() ? 8 : 0) + (m_colors.size() ? 3 : 0);
+			const int face_size = 1 + 12;
+
+			// records go straight into the file buffer, or through 'local' when a block doesn't fit
+			VECTOR<u8> local(PLY_BLOCK * Max(vertex_size, face_size));
+
+			for (int first = 0, n = m_positions.size(); first < n; first += PLY_BLOCK)
+			{
+				const int count = Min(PLY_BLOCK, n - first);
+				u8* block = fp->reserve(count * vertex_size);
+				u8* dst = block ? block : local.begin();
+
+				for (int i = first; i < first + count; ++i)
+				{
+					dst = store_ply(dst, m_positions[i].x, swap);
+					dst = store_ply(dst, m_positions[i].y, swap);
+					dst = store_ply(dst, m_positions[i].z, swap);
+					if (m_normals.size())
+					{
+						dst = store_ply(dst, m_normals[i].x, swap);
+						dst = store_ply(dst, m_normals[i].y, swap);
+						dst = store_ply(dst, m_normals[i].z, swap);
+					}
+					if (m_uv1.size())
+					{
+						dst = store_ply(dst, m_uv1[i].x, swap);
+						dst = store_ply(dst, m_uv1[i].y, swap);
+					}
+					if (m_colors.size())
+					{
+						*dst++ = u8(Min<u32>(u32(m_colors[i].x * 255.0f), 255));
+						*dst++ = u8(Min<u32>(u32(m_colors[i].y * 255.0f), 255));
+						*dst++ = u8(Min<u32>(u32(m_colors[i].z * 255.0f), 255));
+					}
+				}
+				if (block)
+					fp->commit(count * vertex_size);
+				else
+					fp->write(local.begin(), count * vertex_size);
+			}
+
+			for (int first = 0, n = m_faces.size(); first < n; first += PLY_BLOCK)
+			{
+				const int count = Min(PLY_BLOCK, n - first);
+				u8* block = fp->reserve(count * face_size);
+				u8* dst = block ? block : local.begin();
+
+				for (int i = first; i < first + count; ++i)
+				{
+					*dst++ = 3;
+					dst = store_ply(dst, i32(m_faces[i].i0), swap);
+					dst = store_ply(dst, i32(m_faces[i].i1), swap);
+					dst = store_ply(dst, i32(m_faces[i].i2), swap);
+				}
+				if (block)
+					fp->commit(count * face_size);
+				else
+					fp->write(local.begin(), count * face_size);
+			}
+
+			delete fp;
+			return true;
+		}
+
+		for (int i = 0; i < m_positions.size(); ++i)
+		{
+			TEXT_RECORD r(fp);
+			r.put(m_positions[i].x, 6);
+			r.put(' ');
+			r.put(m_positions[i].y, 6);
+			r.put(' ');
+			r.put(m_positions[i].z, 6);
+			if (m_normals.size())
+			{
+				r.put(' ');
+				r.put(m_normals[i].x, 6);
+				r.put(' ');
+				r.put(m_normals[i].y, 6);
+				r.put(' ');
+				r.put(m_normals[i].z, 6);
+			}
+			if (m_uv1.size())
+			{
+				r.put(' ');
+				r.put(m_uv1[i].x, 4);
+				r.put(' ');
+				r.put(m_uv1[i].y, 4);
+			}
+			if (m_colors.size())
+			{
+				r.put(' ');
+				r.put(int(u32(m_colors[i].x * 255.0f)));
+				r.put(' ');
+				r.put(int(u32(m_colors[i].y * 255.0f)));
+				r.put(' ');
+				r.put(int(u32(m_colors[i].z * 255.0f)));
+				//if (colors_alpha) fp->printf(" %d", u32(m_colors[i].w * 255.0f));
+			}
+			r.put('\n');
+		}
+		for (int i = 0; i < m_faces.size(); ++i)
+		{
+			TEXT_RECORD r(fp);
+			r.put("3 ");
+			r.put(m_faces[i].i0);
+			r.put(' ');
+			r.put(m_faces[i].i1);
+			r.put(' ');
+			r.put(m_faces[i].i2);
+			r.put('\n');
+		}
+		delete fp;
+
+		return true;
+	}
+
+	bool MESH::read_ply(const char* file)
+	{
+		clear();
+
+		FILE* fp = FILE::open(file, FILE::READ | FILE::MMAP);
+		if (!fp) {
+			log("ERROR: can not open '%s' file!\n", file);
+			return false;
+		}
+
+		PLY_FORMAT format = PLY_ASCII;
+		PLY_ELEMENT* elements = new PLY_ELEMENT[PLY_MAX_ELEMENTS];
+		int num_elements = 0;
+		bool header_ok = false;
+
+		FILE_LINES lines(fp);
+		STRING_VIEW line;
+		char word[PLY_NAME_MAX];
+
+		while (lines.next(line))
+		{
+			const char* p = line.ptr;
+			const char* end = line.ptr + line.len;
+			if (!next_word(p, end, word))
+				continue;
+
+			if (!strcmp(word, "format"))
+			{
+				next_word(p, end, word);
+				if (!strcmp(word, "binary_little_endian"))
+					format = PLY_BINARY_LITTLE_ENDIAN;
+				else if (!strcmp(word, "binary_big_endian"))
+					format = PLY_BINARY_BIG_ENDIAN;
+				else if (strcmp(word, "ascii"))
+					break;
+			}
+			else if (!strcmp(word, "element"))
+			{
+				if (num_elements == PLY_MAX_ELEMENTS)
+					break;
+
+				PLY_ELEMENT& e = elements[num_elements++];
+				next_word(p, end, e.name);
+				next_word(p, end, word);
+				e.count = atoi(word);
+				e.record_size = 0;
+				e.num_properties = 0;
+				if (e.count < 0)
+					break;
+			}
+			else if (!strcmp(word, "property"))
+			{
+				if (!num_elements || elements[num_elements - 1].num_properties == PLY_MAX_PROPERTIES)
+					break;
+
+				PLY_ELEMENT& e = elements[num_elements - 1];
+				PLY_PROPERTY& prop = e.properties[e.num_properties++];
+				prop.count_type = PLY_NONE;
+
+				next_word(p, end, word);
+				if (!strcmp(word, "list"))
+				{
+					next_word(p, end, word);
+					prop.count_type = find_ply_type(word);
+					if (prop.count_type == PLY_NONE)
+						break;
+					next_word(p, end, word);
+				}
+				prop.type = find_ply_type(word);
+				if (prop.type == PLY_NONE)
+					break;
+				next_word(p, end, prop.name);
+			}
+			else if (!strcmp(word, "end_header"))
+			{
+				header_ok = true;
+				break;
+			}
+		}
+
+		if (!header_ok)
+		{
+			log("ERROR: unsupported ply header in '%s' file!\n", file);
+			delete[] elements;
+			delete fp;
+			return false;
+		}
+
+		// fixed record layouts, for the bulk decoders
+		for (int i = 0; i < num_elements; ++i)
+		{
+			PLY_ELEMENT& e = elements[i];
+			for (int j = 0; j < e.num_properties; ++j)
+			{
+				e.properties[j].offset = e.record_size;
+				if (e.properties[j].count_type != PLY_NONE)
+				{
+					e.record_size = 0;
+					break;
+				}
+				e.record_size += s_ply_types[e.properties[j].type].size;
+			}
+		}
+
+		int num_vertices = 0;
+		for (int i = 0; i < num_elements; ++i)
+		{
+			if (!strcmp(elements[i].name, "vertex"))
+				num_vertices = elements[i].count;
+		}
+
+		// the binary data starts right after the "end_header" line ending, which FILE_LINES has consumed
+		const u8* body = (const u8*)lines.position();
+		const u8* body_end = fp->data() + fp->size();
+
+		PLY_BINARY_READER binary = { body, body_end, (format == PLY_BINARY_LITTLE_ENDIAN) != is_little_endian_host() };
+		PLY_TEXT_READER text = { (const char*)body, (const char*)body_end };
+
+		bool valid = true;
+		for (int i = 0; i < num_elements && valid; ++i)
+		{
+			const PLY_ELEMENT& e = elements[i];
+			PLY_TARGET targets[PLY_MAX_PROPERTIES];
+			memset(targets, 0, sizeof(targets));
+			int face_list = -1;
+
+			if (!strcmp(e.name, "vertex"))
+			{
+				bool streams[4] = {};
+				for (int j = 0; j < e.num_properties; ++j)
+				{
+					for (int k = 0; k < int(sizeof(s_ply_vertex_properties) / sizeof(s_ply_vertex_properties[0])); ++k)
+					{
+						if (e.properties[j].count_type == PLY_NONE && !strcmp(e.properties[j].name, s_ply_vertex_properties[k].name))
+						{
+							streams[s_ply_vertex_properties[k].stream] = true;
+							break;
+						}
+					}
+				}
+
+				m_positions.resize(num_vertices);
+				m_positions.fill(Vec3(0, 0, 0));
+				if (streams[PLY_NORMAL]) {
+					m_normals.resize(num_vertices);
+					m_normals.fill(Vec3(0, 0, 0));
+				}
+				if (streams[PLY_UV]) {
+					m_uv1.resize(num_vertices);
+					m_uv1.fill(Vec2(0, 0));
+				}
+				if (streams[PLY_COLOR]) {
+					m_colors.resize(num_vertices);
+					m_colors.fill(Vec4(0, 0, 0, 1));
+				}
+
+				for (int j = 0; j < e.num_properties; ++j)
+				{
+					const PLY_PROPERTY& prop = e.properties[j];
+					for (int k = 0; k < int(sizeof(s_ply_vertex_properties) / sizeof(s_ply_vertex_properties[0])); ++k)
+					{
+						if (prop.count_type != PLY_NONE || strcmp(prop.name, s_ply_vertex_properties[k].name))
+							continue;
+
+						const int c = s_ply_vertex_properties[k].component;
+						PLY_TARGET& t = targets[j];
+						t.divisor = 1.0f;
+						switch (s_ply_vertex_properties[k].stream)
+						{
+							case PLY_POSITION: t.base = &m_positions.begin()->x + c; t.stride = 3; break;
+							case PLY_NORMAL: t.base = &m_normals.begin()->x + c; t.stride = 3; break;
+							case PLY_UV: t.base = &m_uv1.begin()->x + c; t.stride = 2; break;
+							case PLY_COLOR:
+								t.base = &m_colors.begin()->x + c;
+								t.stride = 4;
+								if (prop.type == PLY_UINT8 || prop.type == PLY_INT8)
+									t.divisor = 255.0f;
+								else if (prop.type == PLY_UINT16 || prop.type == PLY_INT16)
+									t.divisor = 65535.0f;
+								break;
+						}
+						break;
+					}
+				}
+			}
+			else if (!strcmp(e.name, "face"))
+			{
+				for (int j = 0; j < e.num_properties; ++j)
+				{
+					if (e.properties[j].count_type != PLY_NONE &&
+						(!strcmp(e.properties[j].name, "vertex_indices") || !strcmp(e.properties[j].name, "vertex_index")))
+					{
+						face_list = j;
+						break;
+					}
+				}
+			}
+
+			if (format == PLY_ASCII)
+			{
+				valid = read_ply_records(text, e, targets, face_list, num_vertices, m_faces);
+				continue;
+			}
+
+			if (e.record_size)
+			{
+				// fixed size records: decode in blocks, one property column at a time
+				if (u64(binary.end - binary.ptr) < u64(e.count) * e.record_size)
+				{
+					valid = false;
+					break;
+				}
+				for (int first = 0; first < e.count; first += PLY_BLOCK)
+				{
+					const int count = Min(PLY_BLOCK, e.count - first);
+					const u8* block = binary.ptr + u64(first) * e.record_size;
+					for (int j = 0; j < e.num_properties; ++j)
+					{
+						if (targets[j].base)
+							decode_ply_column(block + e.properties[j].offset, e.record_size, count, binary.swap, e.properties[j].type, targets[j], first);
+					}
+				}
+				binary.ptr += u64(e.count) * e.record_size;
+			}
+			else if (face_list >= 0 && e.num_properties == 1 && e.properties[0].count_type == PLY_UINT8 &&
+				(e.properties[0].type == PLY_INT32 || e.properties[0].type == PLY_UINT32))
+			{
+				valid = read_ply_faces(binary, e, num_vertices, m_faces);
+			}
+			else
+				valid = read_ply_records(binary, e, targets, face_list, num_vertices, m_faces);
+		}
+
+		delete[] elements;
+		delete fp;
+
+		if (!valid)
+		{
+			log("ERROR: invalid or truncated ply data in '%s' file!\n", file);
+			clear();
+			return false;
+		}
+		return true;
+	}
+
+	// .xmesh layout: the header with a fixed table of sections, then the sections, each aligned so the
+	// streams can be used in place from a mapping of the file. the data is in the byte order of the host
+	#define XMESH_MAGIC		0x48534d58	// "XMSH"
+	#define XMESH_VERSION	1
+	#define XMESH_ALIGN		64
+
+	enum XMESH_SECTION_ID
+	{
+		XMESH_POSITIONS,
+		XMESH_NORMALS,
+		XMESH_UV1,
+		XMESH_UV2,
+		XMESH_COLORS,
+		XMESH_FACES,		// FACE records, face ids included
+		XMESH_MATERIALS,	// per material: diffuse, specular, ambient, name length and name
+		XMESH_SECTION_COUNT
+	};
+
+	struct XMESH_SECTION
+	{
+		u32	element_size;
+		u32	count;
+		u64	offset;
+	};
+
+	struct XMESH_HEADER
+	{
+		u32				magic;
+		u32				version;
+		u64				source_time;
+		XMESH_SECTION	sections[XMESH_SECTION_COUNT];
+	};
+
+	static const u32 s_xmesh_element_sizes[XMESH_SECTION_COUNT] = {
+		sizeof(Vec3), sizeof(Vec3), sizeof(Vec2), sizeof(Vec2), sizeof(Vec4), sizeof(MESH::FACE), 1 };
+
+	static u64 xmesh_align(u64 offset)
+	{
+		return (offset + XMESH_ALIGN - 1) & ~u64(XMESH_ALIGN - 1);
+	}
+
+	void MESH::write_materials(VECTOR<u8>& data) const
+	{
+		for (int i = 0; i < m_materials.size(); ++i)
+		{
+			const MATERIAL& m = m_materials[i];
+			const u32 len = u32(m.name.size());
+			data.append((const u8*)&m.diffuse, (const u8*)(&m.diffuse + 1));
+			data.append((const u8*)&m.specular, (const u8*)(&m.specular + 1));
+			data.append((const u8*)&m.ambient, (const u8*)(&m.ambient + 1));
+			data.append((const u8*)&len, (const u8*)(&len + 1));
+			data.append((const u8*)m.name.c_str(), (const u8*)m.name.c_str() + len);
+		}
+	}
+
+	bool MESH::read_materials(const u8* data, u64 size)
+	{
+		// VECTOR moves its elements with memcpy, so the strings must not be pushed one by one; count the
+		// records first and build them all in one go
+		const u64 fixed = sizeof(Vec3) * 3 + sizeof(u32);
+		int count = 0;
+		for (u64 offset = 0; offset < size; ++count)
+		{
+			u32 len;
+			if (size - offset < fixed)
+				return false;
+			memcpy(&len, data + offset + fixed - sizeof(len), sizeof(len));
+			offset += fixed;
+			if (size - offset < len)
+				return false;
+			offset += len;
+		}
+
+		m_materials.reset();
+		m_materials.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			MATERIAL& m = m_materials[i];
+			float f[3][3];
+			u32 len;
+			for (int j = 0; j < 3; ++j)
+				memcpy(f[j], data + sizeof(Vec3) * j, sizeof(f[j]));
+			memcpy(&len, data + sizeof(Vec3) * 3, sizeof(len));
+			m.diffuse = Vec3(f[0][0], f[0][1], f[0][2]);
+			m.specular = Vec3(f[1][0], f[1][1], f[1][2]);
+			m.ambient = Vec3(f[2][0], f[2][1], f[2][2]);
+			m.name.assign((const char*)data + fixed, len);
+			data += fixed + len;
+		}
+		return true;
+	}
+
+	bool MESH::write_xmesh(const char* file, u64 source_time)
+	{
+		VECTOR<u8> materials;
+		write_materials(materials);
+
+		const void* data[XMESH_SECTION_COUNT] = {
+			m_positions.begin(), m_normals.begin(), m_uv1.begin(), m_uv2.begin(), m_colors.begin(), m_faces.begin(), materials.begin() };
+
+		XMESH_HEADER header;
+		memset(&header, 0, sizeof(header));
+		header.magic = XMESH_MAGIC;
+		header.version = XMESH_VERSION;
+		header.source_time = source_time;
+
+		const int counts[XMESH_SECTION_COUNT] = {
+			m_positions.size(), m_normals.size(), m_uv1.size(), m_uv2.size(), m_colors.size(), m_faces.size(), materials.size() };
+
+		XMESH_SECTION* s = header.sections;
+		for (int i = 0; i < XMESH_SECTION_COUNT; ++i)
+		{
+			s[i].element_size = s_xmesh_element_sizes[i];
+			s[i].count = u32(counts[i]);
+		}
+
+		u64 offset = xmesh_align(sizeof(header));
+		for (int i = 0; i < XMESH_SECTION_COUNT; ++i)
+		{
+			s[i].offset = offset;
+			offset = xmesh_align(offset + u64(s[i].element_size) * s[i].count);
+		}
+
+		FILE* fp = FILE::open(file, FILE::WRITE | FILE::TRUNC);
+		if (!fp) {
+			log("ERROR: can not create '%s' file!\n", file);
+			return false;
+		}
+
+		static const u8 padding[XMESH_ALIGN] = {};
+
+		bool ok = fp->write(&header, sizeof(header)) == sizeof(header);
+		u64 pos = sizeof(header);
+		for (int i = 0; i < XMESH_SECTION_COUNT && ok; ++i)
+		{
+			ok = fp->write(padding, u32(s[i].offset - pos)) == s[i].offset - pos;
+
+			// sections are written in pieces so sizes stay within the u32 of FILE::write
+			const u8* ptr = (const u8*)data[i];
+			for (u64 left = u64(s[i].element_size) * s[i].count; left && ok; )
+			{
+				const u32 size = u32(Min<u64>(left, 1u << 30));
+				ok = fp->write(ptr, size) == size;
+				ptr += size;
+				left -= size;
+			}
+			pos = s[i].offset + u64(s[i].element_size) * s[i].count;
+		}
+		delete fp;
+
+		if (!ok)
+			log("ERROR: can not write '%s' file!\n", file);
+		return ok;
+	}
+
+	enum XMESH_RESULT
+	{
+		XMESH_OK,
+		XMESH_MISSING,
+		XMESH_STALE,
+		XMESH_INVALID
+	};
+
+	static XMESH_RESULT map_xmesh(MESH& mesh, const char* file, u64 source_time)
+	{
+		mesh.clear();
+
+		FILE* fp = FILE::open(file, FILE::READ | FILE::MMAP | FILE::COPY_ON_WRITE);
+		if (!fp)
+			return XMESH_MISSING;
+
+		XMESH_HEADER header;
+		const u64 size = fp->size();
+		u8* data = (u8*)fp->data();
+
+		if (size < sizeof(header))
+		{
+			delete fp;
+			return XMESH_INVALID;
+		}
+		memcpy(&header, data, sizeof(header));
+
+		if (header.magic != XMESH_MAGIC || header.version != XMESH_VERSION)
+		{
+			delete fp;
+			return XMESH_INVALID;
+		}
+		if (source_time && header.source_time != source_time)
+		{
+			delete fp;
+			return XMESH_STALE;
+		}
+
+		for (int i = 0; i < XMESH_SECTION_COUNT; ++i)
+		{
+			const XMESH_SECTION& s = header.sections[i];
+			if (s.element_size != s_xmesh_element_sizes[i] || s.count > 0x7fffffff || s.offset % XMESH_ALIGN ||
+				s.offset > size || u64(s.element_size) * s.count > size - s.offset)
+			{
+				delete fp;
+				return XMESH_INVALID;
+			}
+		}
+
+		// the materials are the only part that needs parsing
+		const XMESH_SECTION& ms = header.sections[XMESH_MATERIALS];
+		if (!mesh.read_materials(data + ms.offset, ms.count))
+		{
+			delete fp;
+			return XMESH_INVALID;
+		}
+
+		const XMESH_SECTION* s = header.sections;
+		mesh.m_mapping = fp;
+		mesh.m_positions.set_external((Vec3*)(data + s[XMESH_POSITIONS].offset), int(s[XMESH_POSITIONS].count));
+		mesh.m_normals.set_external((Vec3*)(data + s[XMESH_NORMALS].offset), int(s[XMESH_NORMALS].count));
+		mesh.m_uv1.set_external((Vec2*)(data + s[XMESH_UV1].offset), int(s[XMESH_UV1].count));
+		mesh.m_uv2.set_external((Vec2*)(data + s[XMESH_UV2].offset), int(s[XMESH_UV2].count));
+		mesh.m_colors.set_external((Vec4*)(data + s[XMESH_COLORS].offset), int(s[XMESH_COLORS].count));
+		mesh.m_faces.set_external((MESH::FACE*)(data + s[XMESH_FACES].offset), int(s[XMESH_FACES].count));
+		return XMESH_OK;
+	}
+
+	bool MESH::read_xmesh(const char* file, u64 source_time)
+	{
+		switch (map_xmesh(*this, file, source_time))
+		{
+			case XMESH_OK:
+				return true;
+			case XMESH_MISSING:
+				log("ERROR: can not open '%s' file!\n", file);
+				return false;
+			case XMESH_STALE:
+				log("ERROR: '%s' was built from another version of its source!\n", file);
+				return false;
+			default:
+				log("ERROR: '%s' is not a valid xmesh file!\n", file);
+				return false;
+		}
+	}
+
+	static bool has_extension(const char* file, const char* ext)
+	{
+		const char* dot = strrchr(file, '.');
+		if (!dot)
+			return false;
+		for (; *dot && *ext; ++dot, ++ext)
+		{
+			if (tolower(*dot) != *ext)
+				return false;
+		}
+		return *dot == *ext;
+	}
+
+	bool MESH::read_cached(const char* file)
+	{
+		if (has_extension(file, ".xmesh"))
+			return read_xmesh(file);
+
+		FILE* fp = FILE::open(file, FILE::READ);
+		if (!fp) {
+			log("ERROR: can not open '%s' file!\n", file);
+			return false;
+		}
+		const u64 source_time = fp->get_last_write_time();
+		delete fp;
+
+		const std::string cache = std::string(file) + ".xmesh";
+		if (map_xmesh(*this, cache.c_str(), source_time) == XMESH_OK)
+			return true;
+
+		if (!(has_extension(file, ".ply") ? read_ply(file) : read_obj(file)))
+			return false;
+
+		// a cache that can't be written only costs the next load its speed
+		write_xmesh(cache.c_str(), source_time);
+		return true;
+	}
+
+	// corners of a face that are distinct vertices, a degenerate face uses a vertex once
+	static int unique_face_vertices(const MESH::FACE& face, int* vertices)
+	{
+		int count = 0;
+		vertices[count++] = face.i0;
+		if (face.i1 != face.i0)
+			vertices[count++] = face.i1;
+		if (face.i2 != face.i0 && face.i2 != face.i1)
+			vertices[count++] = face.i2;
+		return count;
+	}
+
+	// counting sort of the faces by vertex: a counting pass, a prefix sum and a scatter pass. on a single
+	// thread the scatter goes in face order and leaves the rows sorted; the parallel scatter claims slots
+	// with atomics in whatever order the workers get there, so its rows are sorted afterwards
+	void MESH::compute_vertex_faces()
+	{
+		const int num_vertices = m_positions.size(), num_faces = m_faces.size();
+		const FACE* faces = m_faces.begin();
+		VECTOR<int>& offsets = m_vertex_faces.offsets;
+		VECTOR<int>& indices = m_vertex_faces.indices;
+		offsets.resize(num_vertices + 1);
 
-		for (int i = 0, in = m_faces.size(); i < in; ++i)
+		if (!jobs_num_workers() || num_faces <= ADJACENCY_BLOCK)
+		{
+			memset(offsets.begin(), 0, (num_vertices + 1) * sizeof(int));
+			int vertices[3];
+			for (int f = 0; f < num_faces; ++f)
+			{
+				for (int j = 0, n = unique_face_vertices(faces[f], vertices); j < n; ++j)
+					offsets[vertices[j] + 1]++;
+			}
+			for (int v = 0; v < num_vertices; ++v)
+				offsets[v + 1] += offsets[v];
+
+			indices.resize(offsets[num_vertices]);
+			for (int f = 0; f < num_faces; ++f)
+			{
+				for (int j = 0, n = unique_face_vertices(faces[f], vertices); j < n; ++j)
+					indices[offsets[vertices[j]]++] = f;
+			}
+
+			// the scatter advanced every offset to the start of the next row
+			for (int v = num_vertices; v > 0; --v)
+				offsets[v] = offsets[v - 1];
+			offsets[0] = 0;
+			return;
+		}
+
+		std::atomic<int>* cursor = new std::atomic<int>[num_vertices];
+		const int vertex_blocks = (num_vertices + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+		const int face_blocks = (num_faces + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int v = b * ADJACENCY_BLOCK, n = Min(v + ADJACENCY_BLOCK, num_vertices); v < n; ++v)
+				cursor[v].store(0, std::memory_order_relaxed);
+		});
+
+		parallel_for(0, face_blocks, 1, [&](int b) {
+			int vertices[3];
+			for (int f = b * ADJACENCY_BLOCK, fn = Min(f + ADJACENCY_BLOCK, num_faces); f < fn; ++f)
+			{
+				for (int j = 0, n = unique_face_vertices(faces[f], vertices); j < n; ++j)
+					cursor[vertices[j]].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		int total = 0;
+		for (int v = 0; v < num_vertices; ++v)
+		{
+			offsets[v] = total;
+			total += cursor[v].load(std::memory_order_relaxed);
+			cursor[v].store(offsets[v], std::memory_order_relaxed);
+		}
+		offsets[num_vertices] = total;
+		indices.resize(total);
+
+		parallel_for(0, face_blocks, 1, [&](int b) {
+			int vertices[3];
+			for (int f = b * ADJACENCY_BLOCK, fn = Min(f + ADJACENCY_BLOCK, num_faces); f < fn; ++f)
+			{
+				for (int j = 0, n = unique_face_vertices(faces[f], vertices); j < n; ++j)
+					indices[cursor[vertices[j]].fetch_add(1, std::memory_order_relaxed)] = f;
+			}
+		});
+
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int v = b * ADJACENCY_BLOCK, n = Min(v + ADJACENCY_BLOCK, num_vertices); v < n; ++v)
+				std::sort(indices.begin() + offsets[v], indices.begin() + offsets[v + 1]);
+		});
+
+		delete[] cursor;
+	}
+
+	// every vertex collects the other corners of its faces. a vertex has at most twice as many neighbors
+	// as faces, so the rows are first written at twice the face offsets and then packed
+	void MESH::compute_vertex_neighbors()
+	{
+		if (m_vertex_faces.size() != m_positions.size())
+			compute_vertex_faces();
+
+		const int num_vertices = m_positions.size();
+		const FACE* faces = m_faces.begin();
+		const ADJACENCY& vertex_faces = m_vertex_faces;
+		VECTOR<int>& offsets = m_vertex_neighbors.offsets;
+		VECTOR<int>& indices = m_vertex_neighbors.indices;
+		offsets.resize(num_vertices + 1);
+
+		VECTOR<int> wide(vertex_faces.indices.size() * 2);
+		wide.resize(vertex_faces.indices.size() * 2);
+
+		const int vertex_blocks = (num_vertices + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int v = b * ADJACENCY_BLOCK, n = Min(v + ADJACENCY_BLOCK, num_vertices); v < n; ++v)
+			{
+				const INDEX_SPAN vf = vertex_faces[v];
+				int* row = wide.begin() + vertex_faces.offsets[v] * 2;
+				int* row_end = row;
+				for (int j = 0; j < vf.size(); ++j)
+				{
+					const FACE& face = faces[vf[j]];
+					for (int k = 0; k < 3; ++k)
+					{
+						if (face.i[k] != v)
+							*row_end++ = face.i[k];
+					}
+				}
+				std::sort(row, row_end);
+				offsets[v + 1] = int(std::unique(row, row_end) - row);
+			}
+		});
+
+		offsets[0] = 0;
+		for (int v = 0; v < num_vertices; ++v)
+			offsets[v + 1] += offsets[v];
+		indices.resize(offsets[num_vertices]);
+
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int v = b * ADJACENCY_BLOCK, n = Min(v + ADJACENCY_BLOCK, num_vertices); v < n; ++v)
+			{
+				if (offsets[v + 1] > offsets[v])
+					memcpy(&indices[offsets[v]], &wide[vertex_faces.offsets[v] * 2], (offsets[v + 1] - offsets[v]) * sizeof(int));
+			}
+		});
+	}
+
+	static bool is_degenerate(const MESH::FACE& face)
+	{
+		return face.i0 == face.i1 || face.i1 == face.i2 || face.i0 == face.i2;
+	}
+
+	// every corner faces the directed edge from its next to its previous corner, and its opposite corner
+	// the same edge the other way around. the edges are hashed on their lower vertex with a counting sort,
+	// so both directions of an edge land in one bucket, and sorting the bucket puts them next to each other.
+	// a directed edge used twice isn't manifold and neither side of it is linked; degenerate faces aren't
+	// linked at all
+	void MESH::compute_corner_table()
+	{
+		const int num_vertices = m_positions.size(), num_corners = m_faces.size() * 3;
+		m_opposite_corners.resize(num_corners);
+		m_opposite_corners.fill(-1);
+		m_vertex_corners.resize(num_vertices);
+		m_vertex_corners.fill(-1);
+
+		// an edge in the bucket of its lower vertex: the other vertex times 2, plus 1 when it leads away from it
+		struct EDGE
+		{
+			int		key;
+			int		corner;
+		};
+
+		VECTOR<int> offsets(num_vertices + 1);
+		offsets.resize(num_vertices + 1);
+		offsets.fill(0);
+		for (int f = 0, fn = m_faces.size(); f < fn; ++f)
+		{
+			const FACE& face = m_faces[f];
+			if (!is_degenerate(face))
+			{
+				offsets[Min(face.i1, face.i2) + 1]++;
+				offsets[Min(face.i2, face.i0) + 1]++;
+				offsets[Min(face.i0, face.i1) + 1]++;
+			}
+		}
+		for (int v = 0; v < num_vertices; ++v)
+			offsets[v + 1] += offsets[v];
+
+		VECTOR<EDGE> edges(offsets[num_vertices]);
+		edges.resize(offsets[num_vertices]);
+		for (int f = 0, fn = m_faces.size(); f < fn; ++f)
+		{
+			const FACE& face = m_faces[f];
+			if (is_degenerate(face))
+				continue;
+
+			for (int j = 0; j < 3; ++j)
+			{
+				const int from = face.i[j == 2 ? 0 : j + 1], to = face.i[j == 0 ? 2 : j - 1];
+				EDGE& e = edges[offsets[Min(from, to)]++];
+				e.key = from < to ? to * 2 + 1 : from * 2;
+				e.corner = f * 3 + j;
+			}
+		}
+		for (int v = num_vertices; v > 0; --v)
+			offsets[v] = offsets[v - 1];
+		offsets[0] = 0;
+
+		const int vertex_blocks = (num_vertices + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int v = b * ADJACENCY_BLOCK, n = Min(v + ADJACENCY_BLOCK, num_vertices); v < n; ++v)
+			{
+				EDGE* bucket = edges.begin() + offsets[v];
+				const int count = offsets[v + 1] - offsets[v];
+				std::sort(bucket, bucket + count, [](const EDGE& a, const EDGE& b) { return a.key < b.key; });
+
+				// the two directions of an edge are keys 2k and 2k + 1, so they sort into one run; it links
+				// only when it holds exactly one of each
+				for (int i = 0; i < count; )
+				{
+					int end = i + 1;
+					while (end < count && (bucket[end].key >> 1) == (bucket[i].key >> 1))
+						++end;
+					if (end - i == 2 && bucket[i].key != bucket[i + 1].key)
+					{
+						m_opposite_corners[bucket[i].corner] = bucket[i + 1].corner;
+						m_opposite_corners[bucket[i + 1].corner] = bucket[i].corner;
+					}
+					i = end;
+				}
+			}
+		});
+
+		// any corner will do for a closed fan, an open one has to be walked back to its first face
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (int f = 0, fn = m_faces.size(); f < fn; ++f)
+			{
+				const FACE& face = m_faces[f];
+				if (is_degenerate(face) != (pass == 1))
+					continue;
+				for (int j = 0; j < 3; ++j)
+				{
+					if (m_vertex_corners[face.i[j]] < 0)
+						m_vertex_corners[face.i[j]] = f * 3 + j;
+				}
+			}
+		}
+		for (int v = 0, n = m_vertex_corners.size(); v < n; ++v)
+		{
+			const int start = m_vertex_corners[v];
+			if (start < 0)
+				continue;
+
+			int c = start;
+			for (;;)
+			{
+				const int opposite = m_opposite_corners[prev_corner(c)];
+				if (opposite < 0)
+					break;
+				c = prev_corner(opposite);
+				if (c == start)
+					break;
+			}
+			m_vertex_corners[v] = c;
+		}
+	}
+
+	bool MESH::is_boundary_vertex(int v) const
+	{
+		const int c = m_vertex_corners[v];
+		return c >= 0 && m_opposite_corners[prev_corner(c)] < 0;
+	}
+
+	int MESH::vertex_ring(int v, int* ring, int max) const
+	{
+		int count = 0, last = -1;
+		for (int c = m_vertex_corners[v]; c >= 0; c = next_ring_corner(v, c))
+		{
+			if (count == max)
+				return -1;
+			ring[count++] = corner_vertex(next_corner(c));
+			last = c;
+		}
+
+		// an open fan ends with the far side of its last face
+		if (last >= 0 && swing_corner(last) < 0)
+		{
+			if (count == max)
+				return -1;
+			ring[count++] = corner_vertex(prev_corner(last));
+		}
+		return count;
+	}
+
+	bool MESH::can_collapse_edge(int c) const
+	{
+		const int a = corner_vertex(next_corner(c)), b = corner_vertex(prev_corner(c));
+		if (!is_boundary_edge(c) && is_boundary_vertex(a) && is_boundary_vertex(b))
+			return false;
+
+		int ring_a[MESH_RING_MAX], ring_b[MESH_RING_MAX];
+		const int count_a = vertex_ring(a, ring_a, MESH_RING_MAX);
+		const int count_b = vertex_ring(b, ring_b, MESH_RING_MAX);
+		if (count_a < 0 || count_b < 0)
+			return false;
+
+		const int opposite = m_opposite_corners[c];
+		const int x = corner_vertex(c), y = opposite >= 0 ? corner_vertex(opposite) : -1;
+		for (int i = 0; i < count_a; ++i)
+		{
+			if (ring_a[i] == x || ring_a[i] == y)
+				continue;
+			for (int j = 0; j < count_b; ++j)
+			{
+				if (ring_a[i] == ring_b[j])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// the vertex cache passes reorder faces and vertices, which the adjacency and corner table index
+	static void clear_connectivity(MESH& mesh)
+	{
+		mesh.m_vertex_faces.clear();
+		mesh.m_vertex_neighbors.clear();
+		mesh.m_opposite_corners.clear();
+		mesh.m_vertex_corners.clear();
+	}
+
+	// moves the faces into 'order', order[i] being the face that goes to slot i
+	static void reorder_faces(MESH& mesh, const VECTOR<int>& order)
+	{
+		const int num_faces = mesh.m_faces.size();
+		VECTOR<MESH::FACE> faces(num_faces);
+		faces.resize(num_faces);
+		for (int i = 0; i < num_faces; ++i)
+			faces[i] = mesh.m_faces[order[i]];
+		memcpy(mesh.m_faces.begin(), faces.begin(), num_faces * sizeof(MESH::FACE));
+
+		if (mesh.m_face_normals.size() == num_faces)
+		{
+			VECTOR<Vec3> normals(num_faces);
+			normals.resize(num_faces);
+			for (int i = 0; i < num_faces; ++i)
+				normals[i] = mesh.m_face_normals[order[i]];
+			memcpy(mesh.m_face_normals.begin(), normals.begin(), num_faces * sizeof(Vec3));
+		}
+		clear_connectivity(mesh);
+	}
+
+	// fifo cache like the post transform cache of the gpu, a vertex is cached while fewer than cache_size
+	// misses have happened since its own
+	MESH::VERTEX_CACHE_STATS MESH::analyze_vertex_cache(int cache_size) const
+	{
+		VERTEX_CACHE_STATS stats = { 0, 0 };
+		const int num_vertices = m_positions.size(), num_faces = m_faces.size();
+		if (!num_faces)
+			return stats;
+
+		VECTOR<int> miss_time(num_vertices);
+		miss_time.resize(num_vertices);
+		miss_time.fill(-1);
+
+		int misses = 0, used = 0;
+		for (int f = 0; f < num_faces; ++f)
 		{
 			for (int j = 0; j < 3; ++j)
 			{
-				int vertex = m_faces[i].i[j];
+				const int v = m_faces[f].i[j];
+				if (miss_time[v] < 0)
+					used++;
+				else if (misses - miss_time[v] <= cache_size)
+					continue;
+				miss_time[v] = misses++;
+			}
+		}
+		stats.acmr = float(misses) / num_faces;
+		stats.atvr = float(misses) / Max(used, 1);
+		return stats;
+	}
+
+	struct VERTEX_SCORES
+	{
+		float	cache[VERTEX_CACHE_SIZE];
+		float	valence[VERTEX_VALENCE_MAX];
+
+		VERTEX_SCORES()
+		{
+			for (int i = 0; i < VERTEX_CACHE_SIZE; ++i)
+				cache[i] = i < 3 ? 0.75f : powf(1.0f - float(i - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+			valence[0] = 0;
+			for (int i = 1; i < VERTEX_VALENCE_MAX; ++i)
+				valence[i] = 2.0f / sqrtf(float(i));
+		}
+	};
+
+	// forsyth's vertex score: the last triangle's vertices get a flat score so they aren't all reused at
+	// once, the rest decay with their cache position; vertices with few faces left get a boost to finish them
+	static float vertex_score(int cache_position, int remaining_faces)
+	{
+		static const VERTEX_SCORES s_scores;	// built once, thread safe
+
+		if (!remaining_faces)
+			return -1.0f;
+
+		float score = cache_position < 0 ? 0.0f : s_scores.cache[cache_position];
+		score += remaining_faces < VERTEX_VALENCE_MAX ? s_scores.valence[remaining_faces] : 2.0f / sqrtf(float(remaining_faces));
+		return score;
+	}
+
+	// greedy: the next face is the best scoring one around the simulated cache, and only the faces of
+	// the vertices whose cache position changed are rescored. when the cache runs dry the next face in
+	// the old order starts over
+	void MESH::optimize_vertex_cache(VERTEX_CACHE_STATS* before, VERTEX_CACHE_STATS* after)
+	{
+		if (before)
+			*before = analyze_vertex_cache();
+
+		const int num_vertices = m_positions.size(), num_faces = m_faces.size();
+		if (!num_faces)
+		{
+			if (after)
+				*after = analyze_vertex_cache();
+			return;
+		}
+
+		// the rows of m_vertex_faces get their active faces in front, 'remaining' long
+		compute_vertex_faces();
+		const ADJACENCY& vertex_faces = m_vertex_faces;
+		VECTOR<int> active(vertex_faces.indices.size());
+		active.resize(vertex_faces.indices.size());
+		memcpy(active.begin(), &vertex_faces.indices[0], vertex_faces.indices.size() * sizeof(int));
+
+		VECTOR<int> remaining(num_vertices), cache_position(num_vertices);
+		VECTOR<float> scores(num_vertices);
+		remaining.resize(num_vertices);
+		cache_position.resize(num_vertices);
+		scores.resize(num_vertices);
+		for (int v = 0; v < num_vertices; ++v)
+		{
+			remaining[v] = vertex_faces.offsets[v + 1] - vertex_faces.offsets[v];
+			cache_position[v] = -1;
+			scores[v] = vertex_score(-1, remaining[v]);
+		}
+
+		VECTOR<float> face_scores(num_faces);
+		VECTOR<u8> emitted(num_faces);
+		face_scores.resize(num_faces);
+		emitted.resize(num_faces);
+		emitted.fill(0);
+		for (int f = 0; f < num_faces; ++f)
+		{
+			int vertices[3];
+			float score = 0;
+			for (int j = 0, n = unique_face_vertices(m_faces[f], vertices); j < n; ++j)
+				score += scores[vertices[j]];
+			face_scores[f] = score;
+		}
+
+		int cache[VERTEX_CACHE_SIZE + 3], cache_size = 0;
+		int new_cache[VERTEX_CACHE_SIZE + 3];
+
+		VECTOR<int> order(num_faces);
+		order.resize(num_faces);
+		int best = -1, next_unemitted = 0;
+		for (int i = 0; i < num_faces; ++i)
+		{
+			if (best < 0)
+			{
+				while (emitted[next_unemitted])
+					next_unemitted++;
+				best = next_unemitted;
+			}
+			order[i] = best;
+			emitted[best] = 1;
+
+			int vertices[3];
+			const int count = unique_face_vertices(m_faces[best], vertices);
+			int new_size = 0;
+			for (int j = 0; j < count; ++j)
+			{
+				const int v = vertices[j];
+				new_cache[new_size++] = v;
 
-				auto& vec = m_vertex_neighbors[vertex];
+				// drop the face from the active part of the row
+				int* row = active.begin() + vertex_faces.offsets[v];
+				const int last = --remaining[v];
+				for (int k = 0; k <= last; ++k)
+				{
+					if (row[k] == best)
+					{
+						Swap(row[k], row[last]);
+						break;
+					}
+				}
+			}
+			for (int j = 0; j < cache_size; ++j)
+			{
+				const int v = cache[j];
+				if (v != vertices[0] && (count < 2 || v != vertices[1]) && (count < 3 || v != vertices[2]))
+					new_cache[new_size++] = v;
+			}
 
-				for (int n = 1; n <= 2; ++n)  // iterate both vertex neihbors
+			// rescore the vertices that moved, or fell out, and the faces around them
+			for (int j = 0; j < new_size; ++j)
+			{
+				const int v = new_cache[j];
+				const int position = j < VERTEX_CACHE_SIZE ? j : -1;
+				cache_position[v] = position;
+
+				const float score = vertex_score(position, remaining[v]);
+				const float delta = score - scores[v];
+				scores[v] = score;
+
+				const int* row = active.begin() + vertex_faces.offsets[v];
+				for (int k = 0; k < remaining[v]; ++k)
+					face_scores[row[k]] += delta;
+			}
+
+			// only once every delta is in are the face scores final; a face shared by several cached
+			// vertices would otherwise be compared before all of its updates
+			best = -1;
+			float best_score = -1.0f;
+			for (int j = 0, n = Min(new_size, int(VERTEX_CACHE_SIZE)); j < n; ++j)
+			{
+				const int v = new_cache[j];
+				const int* row = active.begin() + vertex_faces.offsets[v];
+				for (int k = 0; k < remaining[v]; ++k)
 				{
-					int neighbor = m_faces[i].i[(j + n) % 3];
+					if (face_scores[row[k]] > best_score)
+					{
+						best_score = face_scores[row[k]];
+						best = row[k];
+					}
+				}
+			}
+
+			cache_size = Min(new_size, int(VERTEX_CACHE_SIZE));
+			memcpy(cache, new_cache, cache_size * sizeof(int));
+		}
+
+		reorder_faces(*this, order);
+
+		if (after)
+			*after = analyze_vertex_cache();
+	}
+
+	// sander et al., "fast triangle reordering for vertex locality and reduced overdraw": the cache
+	// friendly order is cut into clusters where the cache starts over anyway (a face missing all three
+	// vertices) and wherever the running ACMR of a cluster gets within 'threshold' of the whole cluster's.
+	// clusters facing out of the mesh are drawn first so they occlude the ones behind them
+	void MESH::optimize_overdraw(float threshold)
+	{
+		const int num_vertices = m_positions.size(), num_faces = m_faces.size();
+		if (!num_faces)
+			return;
+
+		VECTOR<int> miss_time(num_vertices);
+		miss_time.resize(num_vertices);
+
+		// the misses of a cache that starts empty at 'begin'
+		int misses = 0, epoch = 0;
+		auto face_misses = [&](int f) -> int {
+			int count = 0;
+			for (int j = 0; j < 3; ++j)
+			{
+				const int v = m_faces[f].i[j];
+				if (miss_time[v] >= epoch && misses - miss_time[v] <= OVERDRAW_CACHE_SIZE)
+					continue;
+				miss_time[v] = misses++;
+				count++;
+			}
+			return count;
+		};
+		auto restart = [&]() {
+			epoch = misses + OVERDRAW_CACHE_SIZE + 1;
+			misses = epoch;
+		};
 
-					int k = 0;
-					for (int kn = vec.size(); k < kn; ++k)
-						if (vec[k] == neighbor) break;
+		miss_time.fill(-1);
+		VECTOR<int> hard;
+		for (int f = 0; f < num_faces; ++f)
+		{
+			if (face_misses(f) == 3)
+				hard.push_back(f);
+		}
+		hard.push_back(num_faces);
 
-					if (k == vec.size())
-						vec.push_back(neighbor);
+		VECTOR<int> clusters;
+		for (int h = 0; h + 1 < hard.size(); ++h)
+		{
+			const int begin = hard[h], end = hard[h + 1];
+
+			restart();
+			int cluster_misses = 0;
+			for (int f = begin; f < end; ++f)
+				cluster_misses += face_misses(f);
+			const float cluster_acmr = float(cluster_misses) / (end - begin);
+
+			restart();
+			clusters.push_back(begin);
+			int start = begin, running = 0;
+			for (int f = begin; f < end; ++f)
+			{
+				running += face_misses(f);
+				if (f + 1 < end && float(running) / (f + 1 - start) <= cluster_acmr * threshold)
+				{
+					clusters.push_back(f + 1);
+					start = f + 1;
+					running = 0;
+					restart();
 				}
 			}
 		}
+		const int num_clusters = clusters.size();
+		clusters.push_back(num_faces);
+
+		// area weighted centroid and normal of every cluster
+		Vec3 mesh_center(0, 0, 0);
+		float mesh_area = 0;
+		VECTOR<Vec3> centers(num_clusters), normals(num_clusters);
+		centers.resize(num_clusters);
+		normals.resize(num_clusters);
+		for (int c = 0; c < num_clusters; ++c)
+		{
+			Vec3 center(0, 0, 0), normal(0, 0, 0);
+			float area = 0;
+			for (int f = clusters[c]; f < clusters[c + 1]; ++f)
+			{
+				const Vec3 p0 = m_positions[m_faces[f].i0], p1 = m_positions[m_faces[f].i1], p2 = m_positions[m_faces[f].i2];
+				const Vec3 n = cross(p1 - p0, p2 - p0);
+				const float a = length(n);
+				center = center + (p0 + p1 + p2) * (a / 3.0f);
+				normal = normal + n;
+				area += a;
+			}
+			mesh_center = mesh_center + center;
+			mesh_area += area;
+			centers[c] = area > 0 ? center * (1.0f / area) : m_positions[m_faces[clusters[c]].i0];
+			normals[c] = normal;
+		}
+		if (mesh_area > 0)
+			mesh_center = mesh_center * (1.0f / mesh_area);
+
+		VECTOR<float> keys(num_clusters);
+		VECTOR<int> sorted(num_clusters);
+		keys.resize(num_clusters);
+		sorted.resize(num_clusters);
+		for (int c = 0; c < num_clusters; ++c)
+		{
+			const float len = length(normals[c]);
+			keys[c] = len > 0 ? dot(centers[c] - mesh_center, normals[c]) / len : 0.0f;
+			sorted[c] = c;
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [&keys](int a, int b) { return keys[a] > keys[b]; });
+
+		VECTOR<int> order(num_faces);
+		order.resize(num_faces);
+		int dst = 0;
+		for (int i = 0; i < num_clusters; ++i)
+		{
+			for (int f = clusters[sorted[i]]; f < clusters[sorted[i] + 1]; ++f)
+				order[dst++] = f;
+		}
+		reorder_faces(*this, order);
+	}
+
+	template< class T > static void permute_stream(VECTOR<T>& stream, const VECTOR<int>& remap)
+	{
+		const int n = remap.size();
+		if (stream.size() != n)
+			return;
+
+		VECTOR<T> permuted(n);
+		permuted.resize(n);
+		for (int i = 0; i < n; ++i)
+			permuted[remap[i]] = stream[i];
+		memcpy(stream.begin(), permuted.begin(), n * sizeof(T));
+	}
+
+	// numbers the vertices in the order the faces first use them, so the fetches walk the vertex streams
+	// forward. unused vertices keep their relative order at the end
+	void MESH::optimize_vertex_fetch()
+	{
+		const int num_vertices = m_positions.size();
+		VECTOR<int> remap(num_vertices);
+		remap.resize(num_vertices);
+		remap.fill(-1);
+
+		int next = 0;
+		for (int f = 0, n = m_faces.size(); f < n; ++f)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				int& v = m_faces[f].i[j];
+				if (remap[v] < 0)
+					remap[v] = next++;
+				v = remap[v];
+			}
+		}
+		for (int v = 0; v < num_vertices; ++v)
+		{
+			if (remap[v] < 0)
+				remap[v] = next++;
+		}
+
+		permute_stream(m_positions, remap);
+		permute_stream(m_normals, remap);
+		permute_stream(m_uv1, remap);
+		permute_stream(m_uv2, remap);
+		permute_stream(m_colors, remap);
+		clear_connectivity(*this);
 	}
 
 	void MESH::add_cube(Vec3 pos, float size, Vec4 color)
@@ -703,12 +2652,7 @@ namespace xr
 
 	Box3 MESH::compute_box_around_vertices()
 	{
-		Box3 box = Box3::empty();
-		for (int i = 0; i < m_positions.size(); ++i)
-		{
-			box += m_positions[i];
-		}
-		return box;
+		return vec3_bounds(m_positions.begin(), m_positions.size());
 	}
 
 	void MESH::copy_vertices(const MESH& rhs)
@@ -720,46 +2664,136 @@ namespace xr
 		m_colors = rhs.m_colors;
 	}
 
+	// blocks of 8x8x8 cells are hashed and the cells of a block stay next to each other, so the
+	// neighborhood of a cell is mostly a few nearby buckets
+	static u32 hash_weld_cell(int x, int y, int z)
+	{
+		const u32 block = (u32(x >> 3) * 73856093u) ^ (u32(y >> 3) * 19349663u) ^ (u32(z >> 3) * 83492791u);
+		return block << 9 | u32(z & 7) << 6 | u32(y & 7) << 3 | u32(x & 7);
+	}
+
+	// welds the vertices closer than pos_eps times the half diagonal of the mesh bounds. the vertices are
+	// hashed into a grid of cells four times that distance, twice the width of the reach of a vertex, so the
+	// reach touches at most 2 cells on each axis. every vertex is welded to the lowest numbered vertex in
+	// reach that isn't welded itself, the same as a serial sweep in vertex order would; faces that lose an
+	// edge are dropped and the unused vertices compacted
 	void MESH::quantize_vertices(float pos_eps)
 	{
+		const int num_vertices = m_positions.size();
+		if (!num_vertices)
+			return;
+
 		Box3 box = compute_box_around_vertices();
+		const float epsilon = box.radius() * pos_eps;
+		const float eps_sq = epsilon * epsilon;
+		const float inv_cell = epsilon > 0 ? 0.25f / epsilon : 1.0f;
+		const Vec3 origin = box.min();
 
-		VECTOR<int>	verts;
-		verts.resize(m_positions.size());
-		for (int i = 0; i < verts.size(); verts[i] = i++);
+		u32 table_size = 64;
+		while (table_size < u32(num_vertices))
+			table_size *= 2;
+		const u32 table_mask = table_size - 1;
 
-		auto& positions = m_positions;
+		auto cell_of = [&](float x, float origin) -> int {
+			return int(Min(Max((x - origin) * inv_cell, 0.0f), WELD_CELL_MAX));
+		};
+		auto bucket_of = [&](Vec3 p) -> u32 {
+			return hash_weld_cell(cell_of(p.x, origin.x), cell_of(p.y, origin.y), cell_of(p.z, origin.z)) & table_mask;
+		};
 
-		std::sort(verts.begin(), verts.end(), [&positions](int a, int b) -> bool
-		{
-			return positions[a].x < positions[b].x;
+		// counting sort into the hash buckets, in vertex order so every bucket is sorted
+		VECTOR<u32> buckets(num_vertices);
+		buckets.resize(num_vertices);
+		const int vertex_blocks = (num_vertices + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int i = b * ADJACENCY_BLOCK, n = Min(i + ADJACENCY_BLOCK, num_vertices); i < n; ++i)
+				buckets[i] = bucket_of(m_positions[i]);
 		});
 
-		const float epsilon = box.radius() * pos_eps;
-		const float eps_sq = epsilon * epsilon;
-
-		VECTOR<int> mapping;
-		mapping.resize(m_positions.size());
-		for (int i = 0; i < verts.size(); ++i)
-			verts[i] = i;
-
-		for (int i = 0; i < verts.size(); ++i)
+		VECTOR<int> offsets(table_size + 1);
+		offsets.resize(table_size + 1);
+		offsets.fill(0);
+		for (int i = 0; i < num_vertices; ++i)
+			offsets[buckets[i] + 1]++;
+		for (u32 i = 0; i < table_size; ++i)
+			offsets[i + 1] += offsets[i];
+
+		// the positions are copied along so a bucket is scanned without jumping around the mesh
+		VECTOR<int> sorted(num_vertices);
+		VECTOR<Vec3> sorted_positions(num_vertices);
+		sorted.resize(num_vertices);
+		sorted_positions.resize(num_vertices);
+		for (int i = 0; i < num_vertices; ++i)
 		{
-			int j;
-			for (j = i + 1; j < verts.size(); ++j)
+			const int k = offsets[buckets[i]]++;
+			sorted[k] = i;
+			sorted_positions[k] = m_positions[i];
+		}
+		for (u32 i = table_size; i > 0; --i)
+			offsets[i] = offsets[i - 1];
+		offsets[0] = 0;
+
+		// lowest numbered vertex in reach of 'p' below 'limit' that passes 'accept', 'limit' if there's none
+		auto find_lower = [&](Vec3 p, int limit, auto accept) -> int {
+			const int x0 = cell_of(p.x - epsilon, origin.x), x1 = cell_of(p.x + epsilon, origin.x);
+			const int y0 = cell_of(p.y - epsilon, origin.y), y1 = cell_of(p.y + epsilon, origin.y);
+			const int z0 = cell_of(p.z - epsilon, origin.z), z1 = cell_of(p.z + epsilon, origin.z);
+			int best = limit;
+			for (int z = z0; z <= z1; ++z)
+			for (int y = y0; y <= y1; ++y)
+			for (int x = x0; x <= x1; ++x)
 			{
-				int vi = verts[i];
-				int vj = verts[j];
-
-				if (positions[vj].x - positions[vi].x > epsilon) break;
-
-				if (length_sq(m_positions[vi] - m_positions[vj]) < eps_sq)
+				const u32 bucket = hash_weld_cell(x, y, z) & table_mask;
+				for (int k = offsets[bucket], kn = offsets[bucket + 1]; k < kn && sorted[k] < best; ++k)
 				{
-					mapping[vj] = vi;
+					if (length_sq(sorted_positions[k] - p) <= eps_sq && accept(sorted[k]))
+					{
+						best = sorted[k];
+						break;
+					}
 				}
 			}
+			return best;
+		};
+
+		// in bucket order, neighbors are looked up in the buckets the previous vertices just went through
+		VECTOR<int> mapping(num_vertices);
+		mapping.resize(num_vertices);
+		parallel_for(0, vertex_blocks, 1, [&](int b) {
+			for (int k = b * ADJACENCY_BLOCK, n = Min(k + ADJACENCY_BLOCK, num_vertices); k < n; ++k)
+				mapping[sorted[k]] = find_lower(sorted_positions[k], sorted[k], [](int) { return true; });
+		});
+
+		// the lowest vertex in reach is the answer when it stays itself; otherwise the vertex looks again,
+		// for the vertices that do. the lower vertices are final by the time a vertex is reached
+		int welded = 0;
+		for (int i = 0; i < num_vertices; ++i)
+		{
+			int j = mapping[i];
+			if (j != i && mapping[j] != j)
+				j = find_lower(m_positions[i], i, [&mapping](int k) { return mapping[k] == k; });
+			mapping[i] = j;
+			welded += j != i;
 		}
+		if (!welded)
+			return;
+
+		const int num_faces = m_faces.size();
+		const int face_blocks = (num_faces + ADJACENCY_BLOCK - 1) / ADJACENCY_BLOCK;
+		parallel_for(0, face_blocks, 1, [&](int b) {
+			for (int f = b * ADJACENCY_BLOCK, n = Min(f + ADJACENCY_BLOCK, num_faces); f < n; ++f)
+			{
+				FACE& face = m_faces[f];
+				face.i0 = mapping[face.i0];
+				face.i1 = mapping[face.i1];
+				face.i2 = mapping[face.i2];
+				if (is_degenerate(face))
+					face.i0 = -1;
+			}
+		});
 
+		compact_indices();
+		compact_vertices();
 	}
 
 	Vec3 MESH::barycentric_coords(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& p)
@@ -9,6 +9,40 @@
 
 namespace xr
 {
+	struct FILE;
+
+	// read only run of indices inside an ADJACENCY
+	struct INDEX_SPAN
+	{
+		const int*	ptr;
+		int			len;
+
+		int			size() const { return len; }
+		bool		empty() const { return len == 0; }
+		int			operator [] (int i) const { return ptr[i]; }
+		const int*	begin() const { return ptr; }
+		const int*	end() const { return ptr + len; }
+	};
+
+	// compressed sparse rows: row r is indices[offsets[r]] up to indices[offsets[r + 1]], sorted ascending
+	struct ADJACENCY
+	{
+		VECTOR<int>	offsets;
+		VECTOR<int>	indices;
+
+		int			size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+		INDEX_SPAN	operator [] (int row) const
+		{
+			INDEX_SPAN span = { indices.size() ? &indices[0] + offsets[row] : nullptr, offsets[row + 1] - offsets[row] };
+			return span;
+		}
+		void		clear()
+		{
+			offsets.clear();
+			indices.clear();
+		}
+	};
+
 	class MESH
 	{
 	public:
@@ -37,13 +71,18 @@ namespace xr
 		VECTOR<Vec2>	m_uv1, m_uv2;
 		VECTOR<Vec4>	m_colors;
 
-		VECTOR<VECTOR<int>, false>	m_vertex_faces;
-		VECTOR<VECTOR<int>, false>	m_vertex_neighbors;
+		ADJACENCY		m_vertex_faces;		// faces using each vertex
+		ADJACENCY		m_vertex_neighbors;	// vertices sharing an edge with each vertex
 
 	// face data
 		VECTOR<FACE>	m_faces;
 		VECTOR<Vec3>	m_face_normals;
 
+	// corner table: corner c is vertex i[c % 3] of face c / 3 and faces the edge of the other two corners.
+	// built by compute_corner_table and stale once m_faces changes
+		VECTOR<int>		m_opposite_corners;	// the corner facing the same edge from the other side, -1 on boundary and non-manifold edges
+		VECTOR<int>		m_vertex_corners;	// a corner of every vertex, -1 when unused; on the boundary the one the fan starts from
+
 		struct MATERIAL
 		{
 			std::string		name;
@@ -51,6 +90,16 @@ namespace xr
 		};
 		VECTOR<MATERIAL>	m_materials;
 
+		// mapping of the .xmesh file the streams point into, kept until clear()
+		FILE*			m_mapping = nullptr;
+
+		MESH() {}
+		~MESH();
+
+		// the mapping and the streams pointing into it can't be shared
+		MESH(const MESH&) = delete;
+		MESH& operator = (const MESH&) = delete;
+
 		int num_vertices() const { return m_positions.size(); }
 		int num_faces() const { return m_faces.size(); }
 
@@ -133,14 +182,67 @@ namespace xr
 
 		void	compute_face_normals();
 		void	compute_vertex_faces();
-		void	compute_vertex_normals();
+		// unit vertex normals from the faces around them, each face weighted evenly, by its area or by its
+		// angle at the vertex. fills m_face_normals on the way; unused vertices get a zero normal
+		enum NORMAL_WEIGHTING
+		{
+			NORMALS_UNIFORM,
+			NORMALS_AREA,
+			NORMALS_ANGLE
+		};
+		void	compute_vertex_normals(NORMAL_WEIGHTING weighting = NORMALS_ANGLE);
 		void	compute_vertex_neighbors();
+		void	compute_corner_table();
+
+		static int next_corner(int c) { return c % 3 == 2 ? c - 2 : c + 1; }
+		static int prev_corner(int c) { return c % 3 == 0 ? c + 2 : c - 1; }
+		int		corner_vertex(int c) const { return m_faces[c / 3].i[c % 3]; }
+
+		// the corner of the same vertex in the next face around it, -1 at the boundary
+		int		swing_corner(int c) const
+		{
+			const int opposite = m_opposite_corners[next_corner(c)];
+			return opposite < 0 ? -1 : next_corner(opposite);
+		}
+
+		// walks the corners of a vertex: for (int c = m_vertex_corners[v]; c >= 0; c = next_ring_corner(v, c))
+		int		next_ring_corner(int v, int c) const
+		{
+			const int next = swing_corner(c);
+			return next == m_vertex_corners[v] ? -1 : next;
+		}
+
+		bool	is_boundary_edge(int c) const { return m_opposite_corners[c] < 0; }	// the edge facing corner c
+		bool	is_boundary_vertex(int v) const;
+
+		// the vertices sharing an edge with v in fan order; -1 when there are more than 'max'
+		int		vertex_ring(int v, int* ring, int max) const;
+
+		// whether collapsing the edge facing corner c keeps the mesh manifold: the two end vertices may
+		// only share the neighbors across the edge, and an inner edge can't join two boundaries
+		bool	can_collapse_edge(int c) const;
 
 		Box3	compute_box_around_faces();
 		Box3	compute_box_around_vertices();
 
 		void	quantize_vertices(float pos_eps);
 
+		// post transform vertex cache efficiency of the face order: vertices transformed per face (ACMR,
+		// 0.5 at best for a regular grid, 3 at worst) and per used vertex (ATVR, 1 at best)
+		struct VERTEX_CACHE_STATS
+		{
+			float	acmr;
+			float	atvr;
+		};
+		VERTEX_CACHE_STATS	analyze_vertex_cache(int cache_size = 16) const;
+
+		// export passes, in this order: faces into a vertex cache friendly order, clusters of it sorted
+		// against overdraw at most 'threshold' times the ACMR, then the vertices into first use order.
+		// the faces and vertices move, so the adjacency and corner table are cleared
+		void	optimize_vertex_cache(VERTEX_CACHE_STATS* before = nullptr, VERTEX_CACHE_STATS* after = nullptr);
+		void	optimize_overdraw(float threshold = 1.05f);
+		void	optimize_vertex_fetch();
+
 		void	center(Vec3 v);
 
 		void	clear();
@@ -148,9 +250,29 @@ namespace xr
 		bool	write_obj(const char* file, const char* material_file = nullptr);
 		bool	read_obj(const char* file);
 
-		bool	write_ply(const char* file);
+		enum PLY_FORMAT
+		{
+			PLY_ASCII,
+			PLY_BINARY_LITTLE_ENDIAN,
+			PLY_BINARY_BIG_ENDIAN
+		};
+		bool	write_ply(const char* file, PLY_FORMAT format = PLY_ASCII);
 		bool	read_ply(const char* file);
 
+		// binary cache: the streams of a read .xmesh point straight into a copy on write mapping of the file.
+		// source_time is the get_last_write_time() of the file the mesh came from, reading fails when it differs
+		bool	write_xmesh(const char* file, u64 source_time = 0);
+		bool	read_xmesh(const char* file, u64 source_time = 0);
+
+		// the material records of .xmesh and packed meshes: diffuse, specular, ambient, name length and name.
+		// read_materials leaves m_materials alone when a record is cut short
+		void	write_materials(VECTOR<u8>& data) const;
+		bool	read_materials(const u8* data, u64 size);
+
+		// reads an .obj, .ply or .xmesh file; .obj and .ply go through a "<file>.xmesh" sidecar that is
+		// rebuilt whenever the source file changes
+		bool	read_cached(const char* file);
+
 		void	add_cube(Vec3 pos, float size, Vec4 color);
 
 		void	set_material_name(int index, const char* name);
@@ -0,0 +1,453 @@
+#include <xr/mesh_codec.h>
+#include <xr/vec3_kernels.h>
+#include <xr/file.h>
+#include <xr/job_manager.h>
+#include <string.h>
+#include <math.h>
+
+#define PACK_MAGIC		0x4b504d58	// "XMPK"
+#define PACK_VERSION	1
+#define PACK_BITS_MAX	24			// quantized coordinates stay exact in a float
+#define PACK_VARINT_MAX	5			// bytes of a coded u32
+
+namespace xr
+{
+	enum PACK_STREAM_ID
+	{
+		PACK_POSITIONS,
+		PACK_NORMALS,
+		PACK_UV1,
+		PACK_UV2,
+		PACK_COLORS,
+		PACK_FACES,		// three indices, then the id when the mesh has materials
+		PACK_MATERIALS,	// as in .xmesh: diffuse, specular, ambient, name length and name
+		PACK_STREAM_COUNT
+	};
+
+	// a component decodes to min + q * step
+	struct PACK_GRID
+	{
+		float	min[4];
+		float	step[4];
+	};
+
+	// the data is in the byte order of the host, the coded streams follow the header in order
+	struct PACK_HEADER
+	{
+		u32			magic;
+		u32			version;
+		u32			face_ids;
+		u32			counts[PACK_STREAM_COUNT];	// elements, bytes for the materials
+		u32			bits[PACK_STREAM_COUNT];
+		u64			sizes[PACK_STREAM_COUNT];
+		PACK_GRID	grids[PACK_STREAM_COUNT];
+	};
+
+	static const int s_pack_dims[PACK_STREAM_COUNT] = { 3, 2, 2, 2, 4, 0, 0 };
+
+	static inline u32 zigzag(int v)
+	{
+		return (u32(v) << 1) ^ u32(v >> 31);
+	}
+
+	static inline u32 unzigzag(u32 v)
+	{
+		return (v >> 1) ^ (0 - (v & 1));
+	}
+
+	static inline u8* put_varint(u8* p, u32 v)
+	{
+		while (v >= 0x80)
+		{
+			*p++ = u8(v | 0x80);
+			v >>= 7;
+		}
+		*p++ = u8(v);
+		return p;
+	}
+
+	static inline bool get_varint(const u8*& p, const u8* end, u32& v)
+	{
+		if (p < end && *p < 0x80)
+		{
+			v = *p++;
+			return true;
+		}
+		v = 0;
+		for (int shift = 0; shift < 7 * PACK_VARINT_MAX && p < end; shift += 7)
+		{
+			const u8 b = *p++;
+			v |= u32(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	static inline u32 quantize(float v, float min, float inv_step, u32 max)
+	{
+		const float q = (v - min) * inv_step + 0.5f;
+		return q <= 0 ? 0 : Min<u32>(u32(q), max);
+	}
+
+	static inline float sign_not_zero(float v)
+	{
+		return v < 0 ? -1.0f : 1.0f;
+	}
+
+	// unit vector to the octahedron folded onto the square [-1, 1]^2; a zero vector comes back as +z
+	static inline void octahedral_encode(Vec3 n, float* uv)
+	{
+		const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		uv[0] = l1 > 0 ? n.x / l1 : 0.0f;
+		uv[1] = l1 > 0 ? n.y / l1 : 0.0f;
+		if (n.z < 0)
+		{
+			const float u = uv[0];
+			uv[0] = (1.0f - fabsf(uv[1])) * sign_not_zero(u);
+			uv[1] = (1.0f - fabsf(u)) * sign_not_zero(uv[1]);
+		}
+	}
+
+	static inline Vec3 octahedral_decode(float u, float v)
+	{
+		Vec3 n(u, v, 1.0f - fabsf(u) - fabsf(v));
+		if (n.z < 0)
+		{
+			n.x = (1.0f - fabsf(v)) * sign_not_zero(u);
+			n.y = (1.0f - fabsf(u)) * sign_not_zero(v);
+		}
+		return normalize(n);
+	}
+
+	// per component bounds of 'dim' floats per element, spanned by 2^bits - 1 steps
+	static void make_grid(const float* values, int count, int dim, int bits, PACK_GRID& grid)
+	{
+		float max[4];
+		for (int c = 0; c < dim; ++c)
+		{
+			grid.min[c] = count ? values[c] : 0.0f;
+			max[c] = grid.min[c];
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			for (int c = 0; c < dim; ++c)
+			{
+				const float v = values[i * dim + c];
+				grid.min[c] = v < grid.min[c] ? v : grid.min[c];
+				max[c] = v > max[c] ? v : max[c];
+			}
+		}
+		for (int c = 0; c < dim; ++c)
+			grid.step[c] = (max[c] - grid.min[c]) / float((1u << bits) - 1);
+	}
+
+	// elements of 'dim' quantized components, each coded as the zigzag varint of its difference to the
+	// same component of the previous element. quantize(i, q) fills the components of element i
+	template< class F > static void encode_stream(VECTOR<u8>& out, int count, int dim, F quantize)
+	{
+		u32 prev[4] = {}, q[4];
+		int size = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			quantize(i, q);
+			out.resize(size + PACK_VARINT_MAX * 4);
+			u8* p = out.begin() + size;
+			for (int c = 0; c < dim; ++c)
+			{
+				p = put_varint(p, zigzag(int(q[c] - prev[c])));
+				prev[c] = q[c];
+			}
+			size = int(p - out.begin());
+		}
+		out.resize(size);
+	}
+
+	template< class F > static bool decode_stream(const u8* p, const u8* end, int count, int dim, F store)
+	{
+		u32 q[4] = {};
+		for (int i = 0; i < count; ++i)
+		{
+			for (int c = 0; c < dim; ++c)
+			{
+				u32 v;
+				if (!get_varint(p, end, v))
+					return false;
+				q[c] += unzigzag(v);
+			}
+			store(i, q);
+		}
+		return p == end;
+	}
+
+	// a grid quantized stream of 'dim' floats per element
+	static void encode_grid_stream(VECTOR<u8>& out, const float* values, int count, int dim, int bits, const PACK_GRID& grid)
+	{
+		const u32 max = (1u << bits) - 1;
+		float inv_step[4];
+		for (int c = 0; c < dim; ++c)
+			inv_step[c] = grid.step[c] > 0 ? 1.0f / grid.step[c] : 0.0f;
+
+		encode_stream(out, count, dim, [&](int i, u32* q) {
+			for (int c = 0; c < dim; ++c)
+				q[c] = quantize(values[i * dim + c], grid.min[c], inv_step[c], max);
+		});
+	}
+
+	static bool decode_grid_stream(const u8* p, const u8* end, float* values, int count, int dim, const PACK_GRID& grid)
+	{
+		return decode_stream(p, end, count, dim, [&](int i, const u32* q) {
+			for (int c = 0; c < dim; ++c)
+				values[i * dim + c] = grid.min[c] + float(q[c]) * grid.step[c];
+		});
+	}
+
+	static void encode_faces(VECTOR<u8>& out, const MESH::FACE* faces, int count, bool ids)
+	{
+		int next = 0, prev_id = 0, size = 0;
+		for (int f = 0; f < count; ++f)
+		{
+			out.resize(size + PACK_VARINT_MAX * 4);
+			u8* p = out.begin() + size;
+			for (int j = 0; j < 3; ++j)
+			{
+				const int v = faces[f].i[j];
+				p = put_varint(p, zigzag(next - v));
+				next = Max(next, v + 1);
+			}
+			if (ids)
+			{
+				p = put_varint(p, zigzag(faces[f].id - prev_id));
+				prev_id = faces[f].id;
+			}
+			size = int(p - out.begin());
+		}
+		out.resize(size);
+	}
+
+	static bool decode_faces(const u8* p, const u8* end, MESH::FACE* faces, int count, bool ids, int num_vertices)
+	{
+		int next = 0, id = 0;
+		for (int f = 0; f < count; ++f)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				u32 v;
+				if (!get_varint(p, end, v))
+					return false;
+				const int index = next - int(unzigzag(v));
+				if (index < 0 || index >= num_vertices)
+					return false;
+				faces[f].i[j] = index;
+				next = Max(next, index + 1);
+			}
+			if (ids)
+			{
+				u32 v;
+				if (!get_varint(p, end, v))
+					return false;
+				id += int(unzigzag(v));
+			}
+			faces[f].id = id;
+		}
+		return p == end;
+	}
+
+	// the fewest bits whose half step over 'extent' stays within 'error'
+	static int bits_for_error(float extent, float error)
+	{
+		int bits = 1;
+		while (bits < PACK_BITS_MAX && extent / float((1u << bits) - 1) * 0.5f > error)
+			++bits;
+		return bits;
+	}
+
+	bool pack_mesh(const MESH& mesh, VECTOR<u8>& data, const MESH_PACK_PARAMS& params)
+	{
+		const int bits[PACK_STREAM_COUNT] = { params.position_bits, params.normal_bits, params.uv_bits, params.uv_bits, params.color_bits, 0, 0 };
+		for (int i = 0; i < PACK_FACES; ++i)
+		{
+			if (bits[i] < 1 || bits[i] > PACK_BITS_MAX)
+			{
+				log("ERROR: pack_mesh quantizes to 1 up to %d bits, not %d!\n", PACK_BITS_MAX, bits[i]);
+				return false;
+			}
+		}
+
+		PACK_HEADER header;
+		memset(&header, 0, sizeof(header));
+		header.magic = PACK_MAGIC;
+		header.version = PACK_VERSION;
+		header.face_ids = mesh.m_materials.size() ? 1 : 0;
+
+		const int counts[PACK_STREAM_COUNT] = {
+			mesh.m_positions.size(), mesh.m_normals.size(), mesh.m_uv1.size(), mesh.m_uv2.size(), mesh.m_colors.size(), mesh.m_faces.size(), 0 };
+		const float* streams[PACK_STREAM_COUNT] = {
+			counts[0] ? &mesh.m_positions[0].x : nullptr, nullptr, counts[2] ? &mesh.m_uv1[0].x : nullptr,
+			counts[3] ? &mesh.m_uv2[0].x : nullptr, counts[4] ? &mesh.m_colors[0].x : nullptr, nullptr, nullptr };
+		for (int i = 0; i < PACK_STREAM_COUNT; ++i)
+		{
+			header.counts[i] = u32(counts[i]);
+			header.bits[i] = u32(bits[i]);
+		}
+
+		// positions share one step, the largest extent gets 'position_bits'
+		PACK_GRID& grid = header.grids[PACK_POSITIONS];
+		Box3 box(Vec3(0, 0, 0));
+		if (counts[0])
+			box = vec3_bounds(&mesh.m_positions[0], counts[0]);
+		const Vec3 extent = box.max() - box.min();
+		const float largest = Max(extent.x, Max(extent.y, extent.z));
+		if (params.position_error > 0)
+			header.bits[PACK_POSITIONS] = u32(bits_for_error(largest, params.position_error));
+		const float step = largest / float((1u << header.bits[PACK_POSITIONS]) - 1);
+		for (int c = 0; c < 3; ++c)
+		{
+			grid.min[c] = (&box.min().x)[c];
+			grid.step[c] = step;
+		}
+		for (int i = PACK_UV1; i <= PACK_COLORS; ++i)
+			make_grid(streams[i], counts[i], s_pack_dims[i], bits[i], header.grids[i]);
+
+		VECTOR<u8> materials;
+		mesh.write_materials(materials);
+		header.counts[PACK_MATERIALS] = u32(materials.size());
+
+		VECTOR<u8> coded[PACK_STREAM_COUNT];
+		parallel_for(0, PACK_MATERIALS, 1, [&](int i) {
+			if (i == PACK_NORMALS)
+			{
+				const u32 max = (1u << bits[i]) - 1;
+				const float scale = float(max) * 0.5f;
+				encode_stream(coded[i], counts[i], 2, [&](int v, u32* q) {
+					float uv[2];
+					octahedral_encode(mesh.m_normals[v], uv);
+					q[0] = quantize(uv[0], -1.0f, scale, max);
+					q[1] = quantize(uv[1], -1.0f, scale, max);
+				});
+			}
+			else if (i == PACK_FACES)
+				encode_faces(coded[i], counts[i] ? &mesh.m_faces[0] : nullptr, counts[i], header.face_ids != 0);
+			else
+				encode_grid_stream(coded[i], streams[i], counts[i], s_pack_dims[i], header.bits[i], header.grids[i]);
+		});
+		coded[PACK_MATERIALS].swap(materials);
+
+		for (int i = 0; i < PACK_STREAM_COUNT; ++i)
+			header.sizes[i] = u64(coded[i].size());
+
+		data.clear();
+		data.append((const u8*)&header, (const u8*)(&header + 1));
+		for (int i = 0; i < PACK_STREAM_COUNT; ++i)
+			data.append(coded[i].begin(), coded[i].end());
+		return true;
+	}
+
+	bool unpack_mesh(MESH& mesh, const u8* data, u64 size)
+	{
+		mesh.clear();
+
+		PACK_HEADER header;
+		if (size < sizeof(header))
+			return false;
+		memcpy(&header, data, sizeof(header));
+		if (header.magic != PACK_MAGIC || header.version != PACK_VERSION)
+			return false;
+
+		const u8* streams[PACK_STREAM_COUNT];
+		u64 offset = sizeof(header);
+		for (int i = 0; i < PACK_STREAM_COUNT; ++i)
+		{
+			if (header.counts[i] > 0x7fffffff || (i < PACK_FACES && (header.bits[i] < 1 || header.bits[i] > PACK_BITS_MAX)) ||
+				header.sizes[i] > size - offset)
+				return false;
+			streams[i] = data + offset;
+			offset += header.sizes[i];
+		}
+
+		if (!mesh.read_materials(streams[PACK_MATERIALS], header.sizes[PACK_MATERIALS]))
+			return false;
+
+		mesh.m_positions.resize(int(header.counts[PACK_POSITIONS]));
+		mesh.m_normals.resize(int(header.counts[PACK_NORMALS]));
+		mesh.m_uv1.resize(int(header.counts[PACK_UV1]));
+		mesh.m_uv2.resize(int(header.counts[PACK_UV2]));
+		mesh.m_colors.resize(int(header.counts[PACK_COLORS]));
+		mesh.m_faces.resize(int(header.counts[PACK_FACES]));
+		float* values[PACK_STREAM_COUNT] = {
+			(float*)mesh.m_positions.begin(), nullptr, (float*)mesh.m_uv1.begin(), (float*)mesh.m_uv2.begin(), (float*)mesh.m_colors.begin(), nullptr, nullptr };
+
+		bool ok[PACK_MATERIALS];
+		parallel_for(0, PACK_MATERIALS, 1, [&](int i) {
+			const u8* begin = streams[i];
+			const u8* end = begin + header.sizes[i];
+			const int count = int(header.counts[i]);
+			if (i == PACK_NORMALS)
+			{
+				const float step = 2.0f / float((1u << header.bits[i]) - 1);
+				Vec3* normals = mesh.m_normals.begin();
+				ok[i] = decode_stream(begin, end, count, 2, [&](int v, const u32* q) {
+					normals[v] = octahedral_decode(-1.0f + float(q[0]) * step, -1.0f + float(q[1]) * step);
+				});
+			}
+			else if (i == PACK_FACES)
+				ok[i] = decode_faces(begin, end, mesh.m_faces.begin(), count, header.face_ids != 0, mesh.m_positions.size());
+			else
+				ok[i] = decode_grid_stream(begin, end, values[i], count, s_pack_dims[i], header.grids[i]);
+		});
+
+		for (int i = 0; i < PACK_MATERIALS; ++i)
+		{
+			if (!ok[i])
+			{
+				mesh.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool write_packed_mesh(const MESH& mesh, const char* file, const MESH_PACK_PARAMS& params)
+	{
+		VECTOR<u8> data;
+		if (!pack_mesh(mesh, data, params))
+			return false;
+
+		FILE* fp = FILE::open(file, FILE::WRITE | FILE::TRUNC);
+		if (!fp) {
+			log("ERROR: can not create '%s' file!\n", file);
+			return false;
+		}
+
+		// written in pieces so sizes stay within the u32 of FILE::write
+		bool ok = true;
+		const u8* ptr = data.begin();
+		for (u64 left = u64(data.size()); left && ok; )
+		{
+			const u32 size = u32(Min<u64>(left, 1u << 30));
+			ok = fp->write(ptr, size) == size;
+			ptr += size;
+			left -= size;
+		}
+		delete fp;
+
+		if (!ok)
+			log("ERROR: can not write '%s' file!\n", file);
+		return ok;
+	}
+
+	bool read_packed_mesh(MESH& mesh, const char* file)
+	{
+		FILE* fp = FILE::open(file, FILE::READ | FILE::MMAP);
+		if (!fp) {
+			log("ERROR: can not open '%s' file!\n", file);
+			return false;
+		}
+		const bool ok = unpack_mesh(mesh, fp->data(), fp->size());
+		delete fp;
+
+		if (!ok)
+			log("ERROR: '%s' is not a valid packed mesh file!\n", file);
+		return ok;
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <xr/mesh.h>
+
+namespace xr
+{
+	// quantized copy of a MESH for disk and for keeping large meshes in memory. positions are on a grid
+	// over the vertex bounds with the same step on every axis, normals are octahedral and uvs and colors
+	// are on a grid over their own bounds. every stream is delta coded per component into zigzag varints,
+	// and face indices are coded against the next vertex not used yet, so a mesh in first use order (see
+	// MESH::optimize_vertex_fetch) spends a byte on most of them
+	struct MESH_PACK_PARAMS
+	{
+		int		position_bits = 16;		// along the largest extent of the bounds, 1 to 24
+		float	position_error = 0.0f;	// when > 0 the fewest position bits that keep every coordinate within it
+		int		normal_bits = 10;		// per octahedral coordinate
+		int		uv_bits = 12;
+		int		color_bits = 8;
+	};
+
+	bool	pack_mesh(const MESH& mesh, VECTOR<u8>& data, const MESH_PACK_PARAMS& params = MESH_PACK_PARAMS());
+	bool	unpack_mesh(MESH& mesh, const u8* data, u64 size);
+
+	// .xmpk files hold the pack_mesh data as it is
+	bool	write_packed_mesh(const MESH& mesh, const char* file, const MESH_PACK_PARAMS& params = MESH_PACK_PARAMS());
+	bool	read_packed_mesh(MESH& mesh, const char* file);
+}
@@ -1,9 +1,16 @@
-#include <xr/mesh.h>
+#include <xr/mesh_simplifier.h>
+#include <xr/job_manager.h>
 
+#include <algorithm>
 #include <map>
 #include <set>
 
-#define VERBOSE 0
+#define SIMPLIFY_BLOCK (16 * 1024)	// vertices or faces per job while setting up
+#define SIMPLIFY_RING_MAX 32		// faces around a vertex a collapse looks at, busier vertices don't collapse
+#define SIMPLIFY_FLIP_DOT 0.25f		// least cosine between a face normal before and after a collapse
+#define SIMPLIFY_DET_MIN 1e-3f		// of the cubed trace, quadrics flatter than that don't get an optimum
+#define SIMPLIFY_POOL_SLACK 2		// face lists are repacked once their pool grows to this many times its start
+#define SIMPLIFY_SEAM -2			// owner of the vertices more than one cluster uses
 
 namespace xr
 {
@@ -353,4 +360,728 @@ namespace xr
 		}
 	}
 #endif
-}
\ No newline at end of file
+
+	// symmetric 4x4 of the plane equations summed into it and the total weight of the planes: error(p)
+	// is the weighted mean of the squared distances of p to the planes
+	// in double: the expanded error is a small difference of large sums, float loses it to cancellation
+	// once a few hundred planes are summed and reports collapses that move a vertex visibly as free
+	struct QUADRIC
+	{
+		double	a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		double	w;	// face planes summed; the error is their mean, the border planes only add a penalty on top
+	};
+
+	static void quadric_add_plane(QUADRIC& q, Vec3 n, float d, float w)
+	{
+		const double x = n.x, y = n.y, z = n.z;
+		q.a2 += w * x * x; q.ab += w * x * y; q.ac += w * x * z; q.ad += w * x * d;
+		q.b2 += w * y * y; q.bc += w * y * z; q.bd += w * y * d;
+		q.c2 += w * z * z; q.cd += w * z * d;
+		q.d2 += double(w) * d * d;
+	}
+
+	static QUADRIC quadric_sum(const QUADRIC& q, const QUADRIC& r)
+	{
+		QUADRIC s;
+		s.a2 = q.a2 + r.a2; s.ab = q.ab + r.ab; s.ac = q.ac + r.ac; s.ad = q.ad + r.ad;
+		s.b2 = q.b2 + r.b2; s.bc = q.bc + r.bc; s.bd = q.bd + r.bd;
+		s.c2 = q.c2 + r.c2; s.cd = q.cd + r.cd;
+		s.d2 = q.d2 + r.d2;
+		s.w = q.w + r.w;
+		return s;
+	}
+
+	static float quadric_error(const QUADRIC& q, Vec3 p)
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		const double e =
+			q.a2 * x * x + q.b2 * y * y + q.c2 * z * z +
+			2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z) +
+			2.0 * (q.ad * x + q.bd * y + q.cd * z) + q.d2;
+		return e > 0 && q.w > 0 ? float(e / q.w) : 0.0f;
+	}
+
+	// the point of least error, false when the planes don't pin one down, like on flat or straight parts
+	static bool quadric_optimum(const QUADRIC& q, Vec3& p)
+	{
+		const double i00 = q.b2 * q.c2 - q.bc * q.bc;
+		const double i01 = q.ac * q.bc - q.ab * q.c2;
+		const double i02 = q.ab * q.bc - q.ac * q.b2;
+		const double i11 = q.a2 * q.c2 - q.ac * q.ac;
+		const double i12 = q.ab * q.ac - q.a2 * q.bc;
+		const double i22 = q.a2 * q.b2 - q.ab * q.ab;
+		const double det = q.a2 * i00 + q.ab * i01 + q.ac * i02;
+		const double trace = q.a2 + q.b2 + q.c2;
+		if (!(fabs(det) > SIMPLIFY_DET_MIN * trace * trace * trace))
+			return false;
+
+		const double inv_det = -1.0 / det;
+		p.x = float((i00 * q.ad + i01 * q.bd + i02 * q.cd) * inv_det);
+		p.y = float((i01 * q.ad + i11 * q.bd + i12 * q.cd) * inv_det);
+		p.z = float((i02 * q.ad + i12 * q.bd + i22 * q.cd) * inv_det);
+		return true;
+	}
+
+	// a candidate edge collapse on the heap. stamps only ever grow, so the entry is current as long as the
+	// stamps of its two vertices still add up to the same sum
+	struct COLLAPSE
+	{
+		float	cost;
+		int		a, b;
+		u32		stamp;
+
+		bool operator < (const COLLAPSE& rhs) const { return cost > rhs.cost; }
+	};
+
+	// the state of simplify_mesh. the live faces of vertex v are in the pool at offsets[v], a collapse
+	// writes the merged list of the surviving vertex to the end of the pool
+	struct QEM_CONTEXT
+	{
+		MESH::FACE*		faces;
+		const float*	weights;
+		VECTOR<Vec3>	positions;	// in the unit box the quadrics are built in
+		VECTOR<Vec3>	normals;	// of the faces before simplifying, zero on degenerate ones
+		VECTOR<QUADRIC>	quadrics;
+		VECTOR<u32>		stamps;
+		VECTOR<u8>		moved;		// positions that changed, only those go back to the mesh
+		VECTOR<int>		offsets, counts, pool;
+		VECTOR<COLLAPSE> heap;
+		int				live_faces;
+		bool			half_edge;	// collapses only go to one of the two ends
+
+		bool can_merge(int a, int b) const
+		{
+			return !weights || (weights[a] != VERTEX_FIXED && weights[a] == weights[b]);
+		}
+
+		// the live faces of v, -1 when there are more than SIMPLIFY_RING_MAX
+		int gather_faces(int v, int* list)
+		{
+			int count = 0;
+			for (int i = offsets[v], n = i + counts[v]; i < n; ++i)
+			{
+				if (faces[pool[i]].i0 < 0)
+					continue;
+				if (count == SIMPLIFY_RING_MAX)
+					return -1;
+				list[count++] = pool[i];
+			}
+			return count;
+		}
+
+		// the other vertices of the faces, each with the number of faces it's in
+		int gather_ring(int v, const int* list, int count, int* ring, int* uses)
+		{
+			int size = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				for (int j = 0; j < 3; ++j)
+				{
+					const int u = faces[list[i]].i[j];
+					if (u == v)
+						continue;
+					int k = 0;
+					while (k < size && ring[k] != u)
+						++k;
+					if (k == size)
+					{
+						ring[size] = u;
+						uses[size++] = 0;
+					}
+					uses[k]++;
+				}
+			}
+			return size;
+		}
+
+		// cost and point of merging a and b: the optimum when there is a good one, else the better end or the middle.
+		// half edge collapses only look at the ends, b first
+		float evaluate(int a, int b, Vec3& target) const
+		{
+			const QUADRIC q = quadric_sum(quadrics[a], quadrics[b]);
+			const Vec3 pa = positions[a], pb = positions[b];
+			if (!half_edge && quadric_optimum(q, target) && length_sq(target - (pa + pb) * 0.5f) <= length_sq(pb - pa))
+				return quadric_error(q, target);
+
+			const Vec3 candidates[3] = { pb, pa, (pa + pb) * 0.5f };
+			float best = FLT_MAX;
+			for (int i = 0, n = half_edge ? 2 : 3; i < n; ++i)
+			{
+				const float e = quadric_error(q, candidates[i]);
+				if (e < best)
+				{
+					best = e;
+					target = candidates[i];
+				}
+			}
+			return best;
+		}
+
+		void push(int a, int b)
+		{
+			Vec3 target;
+			COLLAPSE c = { evaluate(a, b, target), a, b, stamps[a] + stamps[b] };
+			heap.push_back(c);
+			std::push_heap(heap.begin(), heap.end());
+		}
+
+		// faces that move with 'v' may not turn over or collapse to nothing, nor turn away from where they started
+		bool keeps_orientation(int v, int other, Vec3 target, const int* list, int count) const
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				const MESH::FACE& face = faces[list[i]];
+				if (face.i0 == other || face.i1 == other || face.i2 == other)
+					continue;
+
+				Vec3 p[3] = { positions[face.i0], positions[face.i1], positions[face.i2] };
+				const Vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+				for (int j = 0; j < 3; ++j)
+				{
+					if (face.i[j] == v)
+						p[j] = target;
+				}
+				const Vec3 after = cross(p[1] - p[0], p[2] - p[0]);
+				const float len = length(after);
+				if (!(len > 0) || dot(before, after) < SIMPLIFY_FLIP_DOT * length(before) * len || dot(normals[list[i]], after) < SIMPLIFY_FLIP_DOT * len)
+					return false;
+			}
+			return true;
+		}
+
+		// collapses a into b at 'target' unless the result would be folded over or not manifold
+		bool collapse(int a, int b, Vec3 target)
+		{
+			int faces_a[SIMPLIFY_RING_MAX], faces_b[SIMPLIFY_RING_MAX];
+			const int count_a = gather_faces(a, faces_a), count_b = gather_faces(b, faces_b);
+			if (count_a < 0 || count_b < 0)
+				return false;
+
+			// the two ends may only share the vertices across the edge, and an inner edge can't join two borders
+			int ring_a[SIMPLIFY_RING_MAX * 2], ring_b[SIMPLIFY_RING_MAX * 2], uses_a[SIMPLIFY_RING_MAX * 2], uses_b[SIMPLIFY_RING_MAX * 2];
+			const int size_a = gather_ring(a, faces_a, count_a, ring_a, uses_a);
+			const int size_b = gather_ring(b, faces_b, count_b, ring_b, uses_b);
+			int shared = 0, common = 0;
+			bool border_a = false, border_b = false;
+			for (int i = 0; i < size_a; ++i)
+			{
+				if (uses_a[i] > 2)
+					return false;
+				border_a |= uses_a[i] == 1;
+				if (ring_a[i] == b)
+				{
+					shared = uses_a[i];
+					continue;
+				}
+				for (int j = 0; j < size_b; ++j)
+					common += ring_a[i] == ring_b[j];
+			}
+			for (int j = 0; j < size_b; ++j)
+			{
+				if (uses_b[j] > 2)
+					return false;
+				border_b |= uses_b[j] == 1;
+			}
+			if (!shared || common != shared || (shared == 2 && border_a && border_b))
+				return false;
+
+			if (!keeps_orientation(a, b, target, faces_a, count_a) || !keeps_orientation(b, a, target, faces_b, count_b))
+				return false;
+
+			if (target != positions[b])
+			{
+				positions[b] = target;
+				moved[b] = 1;
+			}
+			quadrics[b] = quadric_sum(quadrics[a], quadrics[b]);
+
+			const int offset = pool.size();
+			pool.resize(offset + count_a + count_b);
+			int count = 0;
+			for (int i = 0; i < count_b; ++i)
+			{
+				MESH::FACE& face = faces[faces_b[i]];
+				if (face.i0 == a || face.i1 == a || face.i2 == a)
+				{
+					face.i0 = -1;
+					live_faces--;
+				}
+				else
+					pool[offset + count++] = faces_b[i];
+			}
+			for (int i = 0; i < count_a; ++i)
+			{
+				MESH::FACE& face = faces[faces_a[i]];
+				if (face.i0 < 0)
+					continue;
+				for (int j = 0; j < 3; ++j)
+				{
+					if (face.i[j] == a)
+						face.i[j] = b;
+				}
+				pool[offset + count++] = faces_a[i];
+			}
+			pool.resize(offset + count);
+			offsets[b] = offset;
+			counts[b] = count;
+			counts[a] = 0;
+			stamps[a]++;
+			stamps[b]++;
+
+			for (int i = 0; i < size_a; ++i)
+			{
+				if (ring_a[i] != b && can_merge(b, ring_a[i]))
+					push(b, ring_a[i]);
+			}
+			for (int j = 0; j < size_b; ++j)
+			{
+				if (ring_b[j] != a && can_merge(b, ring_b[j]))
+				{
+					int i = 0;
+					while (i < size_a && ring_a[i] != ring_b[j])
+						++i;
+					if (i == size_a)
+						push(b, ring_b[j]);
+				}
+			}
+			return true;
+		}
+
+		// drops the dead faces and the superseded lists out of the pool
+		void repack()
+		{
+			VECTOR<int> packed(live_faces * 3);
+			for (int v = 0, n = offsets.size(); v < n; ++v)
+			{
+				const int offset = packed.size();
+				for (int i = offsets[v], end = i + counts[v]; i < end; ++i)
+				{
+					if (faces[pool[i]].i0 >= 0)
+						packed.push_back(pool[i]);
+				}
+				offsets[v] = offset;
+				counts[v] = packed.size() - offset;
+			}
+			pool.swap(packed);
+		}
+	};
+
+	// the collapses of simplify_mesh on the whole of 'mesh'. the faces that go are left with i0 == -1 and the
+	// vertices stay where they are, the ones that went just aren't used anymore. with 'splits' the collapses
+	// are half edge ones and recorded
+	static float collapse_edges(MESH& mesh, const SIMPLIFY_PARAMS& params, VECTOR<PROGRESSIVE_MESH::VERTEX_SPLIT>* splits = nullptr)
+	{
+		const int num_vertices = mesh.m_positions.size(), num_faces = mesh.m_faces.size();
+		if (num_faces <= params.target_faces)
+			return 0.0f;
+
+		// faces using a vertex twice go first, they'd only get in the way of the ring checks
+		for (int f = 0; f < num_faces; ++f)
+		{
+			MESH::FACE& face = mesh.m_faces[f];
+			if (face.i0 == face.i1 || face.i1 == face.i2 || face.i0 == face.i2)
+				face.i0 = -1;
+		}
+		mesh.compact_indices();
+		mesh.compute_vertex_faces();
+		mesh.compute_corner_table();
+
+		QEM_CONTEXT ctx;
+		ctx.faces = mesh.m_faces.begin();
+		ctx.weights = params.vertex_weights;
+		ctx.live_faces = mesh.m_faces.size();
+		ctx.half_edge = splits != nullptr;
+
+		// the quadrics are summed in a unit box, where float keeps enough of them
+		Box3 box = mesh.compute_box_around_vertices();
+		const Vec3 origin = box.min(), extent = box.max() - box.min();
+		const float size = Max(extent.x, Max(extent.y, extent.z));
+		const float scale = size > 0 ? 1.0f / size : 1.0f;
+
+		ctx.positions.resize(num_vertices);
+		ctx.quadrics.resize(num_vertices);
+		ctx.stamps.resize(num_vertices);
+		ctx.moved.resize(num_vertices);
+		ctx.offsets.resize(num_vertices);
+		ctx.counts.resize(num_vertices);
+		ctx.pool = mesh.m_vertex_faces.indices;
+
+		const MESH::FACE* faces = ctx.faces;
+		const int* opposite = mesh.m_opposite_corners.begin();
+		const int blocks = (num_vertices + SIMPLIFY_BLOCK - 1) / SIMPLIFY_BLOCK;
+		parallel_for(0, blocks, 1, [&](int b) {
+			for (int v = b * SIMPLIFY_BLOCK, n = Min(v + SIMPLIFY_BLOCK, num_vertices); v < n; ++v)
+			{
+				ctx.positions[v] = (mesh.m_positions[v] - origin) * scale;
+				ctx.stamps[v] = 0;
+				ctx.moved[v] = 0;
+				ctx.offsets[v] = mesh.m_vertex_faces.offsets[v];
+				ctx.counts[v] = mesh.m_vertex_faces.offsets[v + 1] - ctx.offsets[v];
+			}
+		});
+
+		// each vertex gathers the planes of its faces, and of the open edges it's on a plane standing on the edge
+		parallel_for(0, blocks, 1, [&](int b) {
+			for (int v = b * SIMPLIFY_BLOCK, n = Min(v + SIMPLIFY_BLOCK, num_vertices); v < n; ++v)
+			{
+				QUADRIC q;
+				memset(&q, 0, sizeof(q));
+				for (int i = ctx.offsets[v], end = i + ctx.counts[v]; i < end; ++i)
+				{
+					const int f = ctx.pool[i];
+					const MESH::FACE& face = faces[f];
+					const Vec3 p[3] = { (mesh.m_positions[face.i0] - origin) * scale, (mesh.m_positions[face.i1] - origin) * scale, (mesh.m_positions[face.i2] - origin) * scale };
+					const Vec3 normal = cross(p[1] - p[0], p[2] - p[0]);
+					const float len = length(normal);
+					if (!(len > 0))
+						continue;
+					const Vec3 n = normal * (1.0f / len);
+					quadric_add_plane(q, n, -dot(n, p[0]), 1.0f);
+					q.w += 1.0f;
+
+					// corner j faces the edge from corner j + 1 to j + 2
+					for (int j = 0; j < 3; ++j)
+					{
+						const int e0 = (j + 1) % 3, e1 = (j + 2) % 3;
+						if (opposite[f * 3 + j] >= 0 || (face.i[e0] != v && face.i[e1] != v))
+							continue;
+						const Vec3 side = normalize(cross(p[e1] - p[e0], n));
+						quadric_add_plane(q, side, -dot(side, p[e0]), params.boundary_weight);
+					}
+				}
+				ctx.quadrics[v] = q;
+			}
+		});
+
+		const int face_blocks = (ctx.live_faces + SIMPLIFY_BLOCK - 1) / SIMPLIFY_BLOCK;
+		ctx.normals.resize(ctx.live_faces);
+		parallel_for(0, face_blocks, 1, [&](int b) {
+			for (int f = b * SIMPLIFY_BLOCK, n = Min(f + SIMPLIFY_BLOCK, ctx.live_faces); f < n; ++f)
+			{
+				const Vec3 p0 = ctx.positions[faces[f].i0];
+				const Vec3 normal = cross(ctx.positions[faces[f].i1] - p0, ctx.positions[faces[f].i2] - p0);
+				ctx.normals[f] = length_sq(normal) > 0 ? normalize(normal) : Vec3(0, 0, 0);
+			}
+		});
+
+		// every edge once: from the corner of the lower numbered face, or from the only face on open edges
+		ctx.heap.resize(ctx.live_faces * 3);
+		parallel_for(0, face_blocks, 1, [&](int b) {
+			for (int f = b * SIMPLIFY_BLOCK, n = Min(f + SIMPLIFY_BLOCK, ctx.live_faces); f < n; ++f)
+			{
+				for (int j = 0; j < 3; ++j)
+				{
+					const int c = f * 3 + j, a = faces[f].i[(j + 1) % 3], v = faces[f].i[(j + 2) % 3];
+					COLLAPSE& collapse = ctx.heap[c];
+					collapse.a = a;
+					collapse.b = v;
+					collapse.stamp = 0;
+					Vec3 target;
+					collapse.cost = (opposite[c] < 0 || c < opposite[c]) && ctx.can_merge(a, v) ? ctx.evaluate(a, v, target) : -1.0f;
+				}
+			}
+		});
+		int count = 0;
+		for (int i = 0, n = ctx.heap.size(); i < n; ++i)
+		{
+			if (ctx.heap[i].cost >= 0)
+				ctx.heap[count++] = ctx.heap[i];
+		}
+		ctx.heap.resize(count);
+		std::make_heap(ctx.heap.begin(), ctx.heap.end());
+
+		const float max_cost = params.max_error < FLT_MAX ? params.max_error * scale * params.max_error * scale : FLT_MAX;
+		const int repack_size = ctx.pool.size() * SIMPLIFY_POOL_SLACK;
+		float max_applied = 0.0f;
+		while (ctx.live_faces > params.target_faces && !ctx.heap.empty())
+		{
+			const COLLAPSE top = ctx.heap.front();
+			if (top.cost > max_cost)
+				break;
+			std::pop_heap(ctx.heap.begin(), ctx.heap.end());
+			ctx.heap.resize(ctx.heap.size() - 1);
+
+			if (top.stamp != ctx.stamps[top.a] + ctx.stamps[top.b])
+				continue;
+
+			int a = top.a, b = top.b;
+			Vec3 target;
+			ctx.evaluate(a, b, target);
+			if (ctx.half_edge && target != ctx.positions[b])
+				Swap(a, b);
+			if (ctx.collapse(a, b, target))
+			{
+				max_applied = Max(max_applied, top.cost);
+				if (splits)
+				{
+					PROGRESSIVE_MESH::VERTEX_SPLIT split = { a, b, ctx.live_faces, max_applied };
+					splits->push_back(split);
+				}
+			}
+
+			if (ctx.pool.size() > repack_size)
+				ctx.repack();
+		}
+
+		const float inv_scale = size > 0 ? size : 1.0f;
+		if (splits)
+		{
+			for (int i = 0; i < splits->size(); ++i)
+				(*splits)[i].error = sqrtf((*splits)[i].error) * inv_scale;
+		}
+		for (int v = 0; v < num_vertices; ++v)
+		{
+			if (ctx.counts[v] && ctx.moved[v])
+				mesh.m_positions[v] = ctx.positions[v] * inv_scale + origin;
+		}
+
+		return sqrtf(max_applied) * inv_scale;
+	}
+
+	// cuts the faces in [begin, end) of 'order' into 'parts' runs of about the same size, halving the longest
+	// side of the bounds of their centers each time, and adds where every run starts to 'starts'
+	static void split_faces(int* order, const Vec3* centers, int begin, int end, int parts, VECTOR<int>& starts)
+	{
+		if (parts <= 1 || end - begin < 2)
+		{
+			starts.push_back(begin);
+			return;
+		}
+
+		Box3 box = Box3::empty();
+		for (int i = begin; i < end; ++i)
+			box += centers[order[i]];
+		const Vec3 extent = box.max() - box.min();
+		const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+		const int left = parts / 2;
+		const int middle = begin + (int)((i64)(end - begin) * left / parts);
+		std::nth_element(order + begin, order + middle, order + end, [centers, axis](int a, int b) {
+			return (&centers[a].x)[axis] < (&centers[b].x)[axis];
+		});
+		split_faces(order, centers, begin, middle, left, starts);
+		split_faces(order, centers, middle, end, parts - left, starts);
+	}
+
+	// every cluster is simplified on its own, with the vertices it shares with other clusters fixed. the
+	// seams are left as dense as they were, so a last pass over the whole mesh frees just the vertices on
+	// them and their neighbors
+	static float simplify_partitioned(MESH& mesh, const SIMPLIFY_PARAMS& params)
+	{
+		const int num_vertices = mesh.m_positions.size(), num_faces = mesh.m_faces.size();
+
+		VECTOR<Vec3> centers(num_faces);
+		VECTOR<int> order(num_faces);
+		centers.resize(num_faces);
+		order.resize(num_faces);
+		const int face_blocks = (num_faces + SIMPLIFY_BLOCK - 1) / SIMPLIFY_BLOCK;
+		parallel_for(0, face_blocks, 1, [&](int b) {
+			for (int f = b * SIMPLIFY_BLOCK, n = Min(f + SIMPLIFY_BLOCK, num_faces); f < n; ++f)
+			{
+				const MESH::FACE& face = mesh.m_faces[f];
+				centers[f] = mesh.m_positions[face.i0] + mesh.m_positions[face.i1] + mesh.m_positions[face.i2];
+				order[f] = f;
+			}
+		});
+
+		VECTOR<int> starts(params.partitions + 1);
+		split_faces(order.begin(), centers.begin(), 0, num_faces, params.partitions, starts);
+		const int num_clusters = starts.size();
+		starts.push_back(num_faces);
+
+		// the cluster a vertex is in, SIMPLIFY_SEAM when it's in more than one
+		VECTOR<int> owners(num_vertices);
+		owners.resize(num_vertices);
+		owners.fill(-1);
+		for (int k = 0; k < num_clusters; ++k)
+		{
+			for (int i = starts[k]; i < starts[k + 1]; ++i)
+			{
+				const MESH::FACE& face = mesh.m_faces[order[i]];
+				for (int j = 0; j < 3; ++j)
+				{
+					int& owner = owners[face.i[j]];
+					if (owner == -1)
+						owner = k;
+					else if (owner != k)
+						owner = SIMPLIFY_SEAM;
+				}
+			}
+		}
+
+		VECTOR<VECTOR<MESH::FACE>, false> results(num_clusters);
+		VECTOR<float> errors(num_clusters);
+		results.resize(num_clusters);
+		errors.resize(num_clusters);
+		parallel_for(0, num_clusters, 1, [&](int k) {
+			const int begin = starts[k], count = starts[k + 1] - begin;
+
+			VECTOR<int> globals(count * 3);
+			for (int i = begin; i < begin + count; ++i)
+			{
+				const MESH::FACE& face = mesh.m_faces[order[i]];
+				globals.push_back(face.i0);
+				globals.push_back(face.i1);
+				globals.push_back(face.i2);
+			}
+			std::sort(globals.begin(), globals.end());
+			globals.resize((int)(std::unique(globals.begin(), globals.end()) - globals.begin()));
+
+			MESH cluster;
+			VECTOR<float> weights(globals.size());
+			cluster.m_positions.resize(globals.size());
+			weights.resize(globals.size());
+			for (int v = 0; v < globals.size(); ++v)
+			{
+				const int g = globals[v];
+				cluster.m_positions[v] = mesh.m_positions[g];
+				weights[v] = owners[g] == SIMPLIFY_SEAM ? VERTEX_FIXED : (params.vertex_weights ? params.vertex_weights[g] : VERTEX_FREE);
+			}
+			cluster.m_faces.resize(count);
+			for (int i = 0; i < count; ++i)
+			{
+				const MESH::FACE& face = mesh.m_faces[order[begin + i]];
+				MESH::FACE& local = cluster.m_faces[i];
+				for (int j = 0; j < 3; ++j)
+					local.i[j] = (int)(std::lower_bound(globals.begin(), globals.end(), face.i[j]) - globals.begin());
+				local.id = face.id;
+			}
+
+			SIMPLIFY_PARAMS cluster_params = params;
+			cluster_params.target_faces = (int)((i64)params.target_faces * count / num_faces);
+			cluster_params.vertex_weights = weights.begin();
+			errors[k] = collapse_edges(cluster, cluster_params);
+
+			// the seam vertices are fixed, so every vertex written here belongs to this cluster alone
+			for (int v = 0; v < globals.size(); ++v)
+			{
+				if (owners[globals[v]] == k)
+					mesh.m_positions[globals[v]] = cluster.m_positions[v];
+			}
+			VECTOR<MESH::FACE>& result = results[k];
+			for (int i = 0; i < cluster.m_faces.size(); ++i)
+			{
+				MESH::FACE face = cluster.m_faces[i];
+				if (face.i0 < 0)
+					continue;
+				for (int j = 0; j < 3; ++j)
+					face.i[j] = globals[face.i[j]];
+				result.push_back(face);
+			}
+		});
+
+		mesh.m_faces.clear();
+		float error = 0.0f;
+		for (int k = 0; k < num_clusters; ++k)
+		{
+			if (!results[k].empty())
+				mesh.m_faces.append(results[k].begin(), results[k].end());
+			error = Max(error, errors[k]);
+		}
+
+		// the seam pass: the faces on a seam free their vertices, everything else stays fixed
+		VECTOR<float> weights(num_vertices);
+		weights.resize(num_vertices);
+		weights.fill(VERTEX_FIXED);
+		for (int f = 0; f < mesh.m_faces.size(); ++f)
+		{
+			const MESH::FACE& face = mesh.m_faces[f];
+			if (owners[face.i0] != SIMPLIFY_SEAM && owners[face.i1] != SIMPLIFY_SEAM && owners[face.i2] != SIMPLIFY_SEAM)
+				continue;
+			for (int j = 0; j < 3; ++j)
+				weights[face.i[j]] = params.vertex_weights ? params.vertex_weights[face.i[j]] : VERTEX_FREE;
+		}
+		SIMPLIFY_PARAMS seam_params = params;
+		seam_params.vertex_weights = weights.begin();
+		return Max(error, collapse_edges(mesh, seam_params));
+	}
+
+	float simplify_mesh(MESH& mesh, const SIMPLIFY_PARAMS& params)
+	{
+		if (mesh.m_faces.size() <= params.target_faces)
+			return 0.0f;
+
+		const bool normals = mesh.m_normals.size() == mesh.m_positions.size();
+		const float error = params.partitions > 1 && mesh.m_faces.size() > params.partitions ? simplify_partitioned(mesh, params) : collapse_edges(mesh, params);
+
+		mesh.compact_indices();
+		mesh.compact_vertices();
+		mesh.m_vertex_faces.clear();
+		mesh.m_vertex_neighbors.clear();
+		mesh.m_opposite_corners.clear();
+		mesh.m_vertex_corners.clear();
+		mesh.m_face_normals.clear();
+		if (normals)
+			mesh.compute_vertex_normals();
+
+		return error;
+	}
+
+	float build_progressive_mesh(const MESH& mesh, const SIMPLIFY_PARAMS& params, PROGRESSIVE_MESH& pm)
+	{
+		MESH work;
+		work.m_positions = mesh.m_positions;
+		work.m_faces = mesh.m_faces;
+		for (int f = 0; f < work.m_faces.size(); ++f)
+		{
+			MESH::FACE& face = work.m_faces[f];
+			if (face.i0 == face.i1 || face.i1 == face.i2 || face.i0 == face.i2)
+				face.i0 = -1;
+		}
+		work.compact_indices();
+
+		pm.num_vertices = mesh.m_positions.size();
+		pm.faces = work.m_faces;
+		pm.splits.clear();
+		return collapse_edges(work, params, &pm.splits);
+	}
+
+	int PROGRESSIVE_MESH::level(int min_faces, float max_error, VECTOR<MESH::FACE>& out) const
+	{
+		int count = 0;
+		while (count < splits.size() && splits[count].faces >= min_faces && splits[count].error <= max_error)
+			++count;
+
+		// every vertex points at the one it went into, which may have gone on itself
+		VECTOR<int> remap(num_vertices);
+		remap.resize(num_vertices);
+		for (int v = 0; v < num_vertices; ++v)
+			remap[v] = v;
+		for (int i = 0; i < count; ++i)
+			remap[splits[i].vertex] = splits[i].into;
+		for (int v = 0; v < num_vertices; ++v)
+		{
+			int r = remap[v];
+			while (remap[r] != r)
+				r = remap[r];
+			remap[v] = r;
+		}
+
+		out.clear();
+		for (int f = 0; f < faces.size(); ++f)
+		{
+			MESH::FACE face = faces[f];
+			face.i0 = remap[face.i0];
+			face.i1 = remap[face.i1];
+			face.i2 = remap[face.i2];
+			if (face.i0 != face.i1 && face.i1 != face.i2 && face.i0 != face.i2)
+				out.push_back(face);
+		}
+		return count;
+	}
+
+	void PROGRESSIVE_MESH::lod_chain(const float* face_ratios, int num_lods, VECTOR<MESH::FACE>& out, VECTOR<MESH_LOD>& lods) const
+	{
+		VECTOR<MESH::FACE> level_faces;
+		out.clear();
+		lods.clear();
+		for (int i = 0; i < num_lods; ++i)
+		{
+			const int count = level((int)(faces.size() * face_ratios[i]), FLT_MAX, level_faces);
+			MESH_LOD lod = { out.size(), level_faces.size(), count ? splits[count - 1].error : 0.0f };
+			lods.push_back(lod);
+			if (!level_faces.empty())
+				out.append(level_faces.begin(), level_faces.end());
+		}
+	}
+}
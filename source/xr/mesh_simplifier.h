@@ -2,7 +2,7 @@
 
 #include <xr/core.h>
 #include <xr/math.h>
-#include <xr/vector.h>"
+#include <xr/vector.h>
 #include <xr/mesh.h>
 
 
@@ -16,6 +16,62 @@
 
 namespace xr
 {
+	// garland-heckbert edge collapse: every vertex sums the planes of its faces into a quadric, and the
+	// edges are collapsed cheapest first to the point of least quadric error, off a heap whose stale entries
+	// are skipped as they come up. collapses that would fold a face over or break the manifold are left out.
+	// the faces and positions change, the other vertex streams stay with the vertex that survives a collapse
+	struct SIMPLIFY_PARAMS
+	{
+		int				target_faces = 0;			// stops at this many faces...
+		float			max_error = FLT_MAX;		// ...or once the cheapest collapse is further than this off the planes it replaces, root mean square
+		float			boundary_weight = 16.0f;	// of the planes that hold open borders in place, a penalty on top of the error
+		const float*	vertex_weights = nullptr;	// VERTEX_FREE, VERTEX_FIXED... per vertex, only vertices of the same weight merge and fixed ones never do
+		int				partitions = 1;				// > 1 cuts the mesh into this many clusters that are simplified in parallel, see below
+	};
+
+	// with partitions the faces are split k-d fashion on their centers and every cluster is simplified on a job
+	// to its share of target_faces, with the vertices it shares with others fixed. a last serial pass then frees
+	// the vertices around the seams, the rest stays fixed. the result depends on the number of partitions, not
+	// on the number of workers; errors of the two passes may add up near the seams.
+	// returns the error of the most expensive collapse done
+	float	simplify_mesh(MESH& mesh, const SIMPLIFY_PARAMS& params);
+
+	// a run of faces in a lod chain
+	struct MESH_LOD
+	{
+		int		first_face;
+		int		num_faces;
+		float	error;
+	};
+
+	// one simplification run kept as the sequence of its collapses, so levels of detail can be cut from it at
+	// any face count or error without simplifying again. the collapses are half edge ones that only move a
+	// vertex onto the other end of its edge, so every level is a list of faces over the vertices of the mesh
+	struct PROGRESSIVE_MESH
+	{
+		// a collapse, and read backwards the vertex split that undoes it
+		struct VERTEX_SPLIT
+		{
+			int		vertex;		// that went
+			int		into;		// the vertex it went into
+			int		faces;		// left after the collapse
+			float	error;		// of the most expensive collapse up to this one
+		};
+
+		int						num_vertices = 0;
+		VECTOR<MESH::FACE>		faces;		// before the first collapse
+		VECTOR<VERTEX_SPLIT>	splits;		// in the order of the collapses
+
+		// the faces after the collapses that leave at least 'min_faces' and stay within 'max_error', returns how many those are
+		int		level(int min_faces, float max_error, VECTOR<MESH::FACE>& out) const;
+
+		// the levels with face_ratios[i] of the faces one after the other in 'out', for one index buffer
+		void	lod_chain(const float* face_ratios, int num_lods, VECTOR<MESH::FACE>& out, VECTOR<MESH_LOD>& lods) const;
+	};
+
+	// the mesh isn't changed, the run goes as far as target_faces and max_error allow; partitions are ignored
+	float	build_progressive_mesh(const MESH& mesh, const SIMPLIFY_PARAMS& params, PROGRESSIVE_MESH& pm);
+
 	class mesh_simplifier
 	{
 	public:
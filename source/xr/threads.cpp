@@ -1,10 +1,29 @@
 #include <xr/threads.h>
-#include <Windows.h>
-
 
+#ifdef _WIN32
+#include <Windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <atomic>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
 
 namespace xr
 {
+	struct THREAD_START
+	{
+		void	(*func)(void*);
+		void*	param;
+	};
+
+#ifdef _WIN32
 	CRITICAL_SECTION::CRITICAL_SECTION()
 	{
 		m_data = new ::CRITICAL_SECTION();
@@ -13,6 +32,7 @@ namespace xr
 	CRITICAL_SECTION::~CRITICAL_SECTION()
 	{
 		DeleteCriticalSection((::CRITICAL_SECTION*)m_data);
+		delete (::CRITICAL_SECTION*)m_data;
 	}
 	void CRITICAL_SECTION::enter()
 	{
@@ -43,4 +63,271 @@ namespace xr
 	{
 		WaitForSingleObject((HANDLE)m_data, INFINITE);
 	}
-}
\ No newline at end of file
+	bool EVENT::wait(u32 timeout_ms)
+	{
+		return WaitForSingleObject((HANDLE)m_data, timeout_ms) == WAIT_OBJECT_0;
+	}
+
+	static unsigned __stdcall thread_start(void* param)
+	{
+		THREAD_START start = *(THREAD_START*)param;
+		delete (THREAD_START*)param;
+		start.func(start.param);
+		return 0;
+	}
+
+	THREAD thread_create(void (*func)(void*), void* param, u32 stack_size)
+	{
+		THREAD_START* start = new THREAD_START;
+		start->func = func;
+		start->param = param;
+
+		uintptr_t handle = _beginthreadex(NULL, stack_size, thread_start, start, 0, NULL);
+		if (!handle)
+		{
+			delete start;
+			return nullptr;
+		}
+		return (THREAD)handle;
+	}
+
+	void thread_join(THREAD thread)
+	{
+		WaitForSingleObject((HANDLE)thread, INFINITE);
+		CloseHandle((HANDLE)thread);
+	}
+
+	int get_num_cores()
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return int(info.dwNumberOfProcessors);
+	}
+#else
+	// recursive, like the win32 critical section
+	CRITICAL_SECTION::CRITICAL_SECTION()
+	{
+		pthread_mutexattr_t attr;
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+
+		m_data = new pthread_mutex_t;
+		pthread_mutex_init((pthread_mutex_t*)m_data, &attr);
+		pthread_mutexattr_destroy(&attr);
+	}
+	CRITICAL_SECTION::~CRITICAL_SECTION()
+	{
+		pthread_mutex_destroy((pthread_mutex_t*)m_data);
+		delete (pthread_mutex_t*)m_data;
+	}
+	void CRITICAL_SECTION::enter()
+	{
+		pthread_mutex_lock((pthread_mutex_t*)m_data);
+	}
+	void CRITICAL_SECTION::leave()
+	{
+		pthread_mutex_unlock((pthread_mutex_t*)m_data);
+	}
+
+	static timespec deadline_after_ms(u32 timeout_ms)
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += timeout_ms / 1000;
+		ts.tv_nsec += long(timeout_ms % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		return ts;
+	}
+
+#ifdef __linux__
+	// auto reset event on a futex word: 1 when signaled, a successful wait consumes the signal
+	struct EVENT_DATA
+	{
+		std::atomic<int> state;
+	};
+
+	static void futex_wait(std::atomic<int>* addr, int value, const timespec* timeout)
+	{
+		syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, value, timeout, nullptr, 0);
+	}
+
+	static void futex_wake(std::atomic<int>* addr, int count)
+	{
+		syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+	}
+
+	EVENT::EVENT()
+	{
+		m_data = new EVENT_DATA;
+		((EVENT_DATA*)m_data)->state.store(0);
+	}
+	EVENT::~EVENT()
+	{
+		delete (EVENT_DATA*)m_data;
+	}
+	void EVENT::reset()
+	{
+		((EVENT_DATA*)m_data)->state.store(0);
+	}
+	void EVENT::signal()
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		if (data->state.exchange(1) == 0)
+			futex_wake(&data->state, 1);
+	}
+	void EVENT::wait()
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		for (;;)
+		{
+			int expected = 1;
+			if (data->state.compare_exchange_strong(expected, 0))
+				return;
+			futex_wait(&data->state, 0, nullptr);
+		}
+	}
+	bool EVENT::wait(u32 timeout_ms)
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		const timespec deadline = deadline_after_ms(timeout_ms);
+		for (;;)
+		{
+			int expected = 1;
+			if (data->state.compare_exchange_strong(expected, 0))
+				return true;
+
+			// FUTEX_WAIT takes a relative timeout
+			timespec now, left;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			left.tv_sec = deadline.tv_sec - now.tv_sec;
+			left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+			if (left.tv_nsec < 0)
+			{
+				left.tv_sec--;
+				left.tv_nsec += 1000000000;
+			}
+			if (left.tv_sec < 0)
+				return false;
+
+			futex_wait(&data->state, 0, &left);
+		}
+	}
+#else
+	struct EVENT_DATA
+	{
+		pthread_mutex_t	mutex;
+		pthread_cond_t	cond;
+		bool			signaled;
+	};
+
+	EVENT::EVENT()
+	{
+		EVENT_DATA* data = new EVENT_DATA;
+		pthread_mutex_init(&data->mutex, nullptr);
+
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&data->cond, &attr);
+		pthread_condattr_destroy(&attr);
+
+		data->signaled = false;
+		m_data = data;
+	}
+	EVENT::~EVENT()
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		pthread_cond_destroy(&data->cond);
+		pthread_mutex_destroy(&data->mutex);
+		delete data;
+	}
+	void EVENT::reset()
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		pthread_mutex_lock(&data->mutex);
+		data->signaled = false;
+		pthread_mutex_unlock(&data->mutex);
+	}
+	void EVENT::signal()
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		pthread_mutex_lock(&data->mutex);
+		data->signaled = true;
+		pthread_cond_signal(&data->cond);
+		pthread_mutex_unlock(&data->mutex);
+	}
+	void EVENT::wait()
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		pthread_mutex_lock(&data->mutex);
+		while (!data->signaled)
+			pthread_cond_wait(&data->cond, &data->mutex);
+		data->signaled = false;
+		pthread_mutex_unlock(&data->mutex);
+	}
+	bool EVENT::wait(u32 timeout_ms)
+	{
+		EVENT_DATA* data = (EVENT_DATA*)m_data;
+		const timespec deadline = deadline_after_ms(timeout_ms);
+
+		pthread_mutex_lock(&data->mutex);
+		while (!data->signaled)
+		{
+			if (pthread_cond_timedwait(&data->cond, &data->mutex, &deadline) == ETIMEDOUT)
+				break;
+		}
+		const bool signaled = data->signaled;
+		data->signaled = false;
+		pthread_mutex_unlock(&data->mutex);
+		return signaled;
+	}
+#endif
+
+	static void* thread_start(void* param)
+	{
+		THREAD_START start = *(THREAD_START*)param;
+		delete (THREAD_START*)param;
+		start.func(start.param);
+		return nullptr;
+	}
+
+	THREAD thread_create(void (*func)(void*), void* param, u32 stack_size)
+	{
+		THREAD_START* start = new THREAD_START;
+		start->func = func;
+		start->param = param;
+
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		if (stack_size)
+			pthread_attr_setstacksize(&attr, stack_size);
+
+		pthread_t* thread = new pthread_t;
+		const int result = pthread_create(thread, &attr, thread_start, start);
+		pthread_attr_destroy(&attr);
+
+		if (result)
+		{
+			delete start;
+			delete thread;
+			return nullptr;
+		}
+		return thread;
+	}
+
+	void thread_join(THREAD thread)
+	{
+		pthread_join(*(pthread_t*)thread, nullptr);
+		delete (pthread_t*)thread;
+	}
+
+	int get_num_cores()
+	{
+		return int(sysconf(_SC_NPROCESSORS_ONLN));
+	}
+#endif
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <xr/core.h>
+
 namespace xr
 {
 	#define CS_SCOPE(cs) CRITICAL_SECTION_SCOPE css(cs)
@@ -38,9 +40,15 @@ namespace xr
 		void reset();
 		void signal();
 		void wait();
+		bool wait(u32 timeout_ms);	// returns false on timeout
 
 	private:
 		void* m_data;
 	};
 
+	typedef void* THREAD;
+
+	THREAD	thread_create(void (*func)(void*), void* param, u32 stack_size);
+	void	thread_join(THREAD thread);	// waits for the thread to finish and releases it
+	int		get_num_cores();
 }
\ No newline at end of file
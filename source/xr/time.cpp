@@ -1,32 +1,88 @@
 #include <xr/time.h>
+
+#include <atomic>
+#include <string.h>
+
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define XR_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define XR_HAS_RDTSC
+#endif
 
 namespace xr
 {
 	static u64	g_time_app_start;
 
-	static u64 get_ticks()
+	static void profile_report_at_exit();
+
+#ifdef _WIN32
+	u64 get_ticks()
 	{
 		LARGE_INTEGER li;
 		::QueryPerformanceCounter(&li);
 		return li.QuadPart;
 	}
 
+	u64 get_ticks_frequency()
+	{
+		static LARGE_INTEGER freq = { 0 };
+		if (!freq.QuadPart)
+			::QueryPerformanceFrequency(&freq);
+		return freq.QuadPart;
+	}
+#else
+	u64 get_ticks()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return u64(ts.tv_sec) * 1000000000ULL + u64(ts.tv_nsec);
+	}
+
+	u64 get_ticks_frequency()
+	{
+		return 1000000000ULL;
+	}
+#endif
+
+	u64 ticks_to_ns(u64 ticks)
+	{
+		const u64 freq = get_ticks_frequency();
+		return (ticks / freq) * 1000000000ULL + (ticks % freq) * 1000000000ULL / freq;
+	}
+
+	u64 get_cycles()
+	{
+#ifdef XR_HAS_RDTSC
+		return __rdtsc();
+#else
+		return get_ticks();
+#endif
+	}
+
 	struct TIME_INITIALIZATION
 	{
 		TIME_INITIALIZATION()
 		{
 			g_time_app_start = get_ticks();
 		}
+		~TIME_INITIALIZATION()
+		{
+			profile_report_at_exit();
+		}
 	}
 	g_time_initialization;
 
 	static u32 time_difference_ms(u64 t1, u64 t2)
 	{
-		static LARGE_INTEGER freq = { 0 };
-		if(!freq.QuadPart)
-			::QueryPerformanceFrequency(&freq);
-		return (t2 - t1) * 1000 / freq.QuadPart;
+		return u32(ticks_to_ns(t2 - t1) / 1000000);
 	}
 
 	TIME_SCOPE::TIME_SCOPE()
@@ -44,8 +100,180 @@ namespace xr
 		return time_difference_ms(m_ticks, get_ticks());
 	}
 
+	u64 TIME_SCOPE::measure_duration_us()
+	{
+		return ticks_to_ns(get_ticks() - m_ticks) / 1000;
+	}
+
+	u64 TIME_SCOPE::measure_duration_ns()
+	{
+		return ticks_to_ns(get_ticks() - m_ticks);
+	}
+
 	u32 get_time_ms()
 	{
 		return time_difference_ms(g_time_app_start, get_ticks());
 	}
-}
\ No newline at end of file
+
+	u64 get_time_ns()
+	{
+		return ticks_to_ns(get_ticks() - g_time_app_start);
+	}
+
+	// profiling zones
+
+	struct PROFILE_ZONE_NODE
+	{
+		const char*			name;
+		PROFILE_ZONE_NODE*	parent;
+		PROFILE_ZONE_NODE*	children;
+		PROFILE_ZONE_NODE*	next;		// next sibling
+		u64					count;
+		u64					total;		// ticks
+		u64					min;
+		u64					max;
+	};
+
+	// every thread that enters a zone owns a tree, the trees are only read by the report
+	struct PROFILE_ZONE_THREAD
+	{
+		PROFILE_ZONE_NODE		root;
+		PROFILE_ZONE_THREAD*	next;
+	};
+
+	static std::atomic<PROFILE_ZONE_THREAD*>	s_zone_threads(nullptr);
+	static thread_local PROFILE_ZONE_NODE*		s_zone_current = nullptr;
+
+	static PROFILE_ZONE_NODE* new_zone_node(const char* name, PROFILE_ZONE_NODE* parent)
+	{
+		PROFILE_ZONE_NODE* node = new PROFILE_ZONE_NODE;
+		node->name = name;
+		node->parent = parent;
+		node->children = nullptr;
+		node->next = nullptr;
+		node->count = 0;
+		node->total = 0;
+		node->min = ~0ULL;
+		node->max = 0;
+
+		// append, so the report lists zones in the order they were first entered
+		if (parent)
+		{
+			PROFILE_ZONE_NODE** link = &parent->children;
+			while (*link)
+				link = &(*link)->next;
+			*link = node;
+		}
+		return node;
+	}
+
+	static PROFILE_ZONE_NODE* zone_thread_root()
+	{
+		PROFILE_ZONE_THREAD* thread = new PROFILE_ZONE_THREAD;
+		thread->root.name = "";
+		thread->root.parent = nullptr;
+		thread->root.children = nullptr;
+		thread->root.next = nullptr;
+
+		thread->next = s_zone_threads.load(std::memory_order_relaxed);
+		while (!s_zone_threads.compare_exchange_weak(thread->next, thread, std::memory_order_release, std::memory_order_relaxed))
+			;
+		return &thread->root;
+	}
+
+	PROFILE_ZONE_SCOPE::PROFILE_ZONE_SCOPE(const char* name)
+	{
+		PROFILE_ZONE_NODE* parent = s_zone_current;
+		if (!parent)
+			parent = zone_thread_root();
+
+		// zones are looked up by the address of their name, the report merges equal names from different literals
+		PROFILE_ZONE_NODE* node = parent->children;
+		while (node && node->name != name)
+			node = node->next;
+		if (!node)
+			node = new_zone_node(name, parent);
+
+		s_zone_current = node;
+		m_node = node;
+		m_ticks = get_ticks();
+	}
+
+	PROFILE_ZONE_SCOPE::~PROFILE_ZONE_SCOPE()
+	{
+		const u64 ticks = get_ticks() - m_ticks;
+
+		m_node->count++;
+		m_node->total += ticks;
+		m_node->min = Min(m_node->min, ticks);
+		m_node->max = Max(m_node->max, ticks);
+
+		s_zone_current = m_node->parent;
+	}
+
+	static void merge_zones(PROFILE_ZONE_NODE* dst, const PROFILE_ZONE_NODE* src)
+	{
+		for (const PROFILE_ZONE_NODE* s = src->children; s; s = s->next)
+		{
+			PROFILE_ZONE_NODE* d = dst->children;
+			while (d && strcmp(d->name, s->name))
+				d = d->next;
+			if (!d)
+				d = new_zone_node(s->name, dst);
+
+			d->count += s->count;
+			d->total += s->total;
+			d->min = Min(d->min, s->min);
+			d->max = Max(d->max, s->max);
+
+			merge_zones(d, s);
+		}
+	}
+
+	static void log_zones(const PROFILE_ZONE_NODE* node, int depth)
+	{
+		for (; node; node = node->next)
+		{
+			const double total_ms = double(ticks_to_ns(node->total)) / 1000000.0;
+			const double avg_us = node->count ? double(ticks_to_ns(node->total / node->count)) / 1000.0 : 0.0;
+			const double min_us = node->count ? double(ticks_to_ns(node->min)) / 1000.0 : 0.0;
+			const double max_us = double(ticks_to_ns(node->max)) / 1000.0;
+
+			log("%*s%-*s %10llu %12.3f %12.3f %12.3f %12.3f\n", depth * 2, "", 40 - depth * 2, node->name,
+				(unsigned long long)node->count, total_ms, avg_us, min_us, max_us);
+
+			log_zones(node->children, depth + 1);
+		}
+	}
+
+	static void delete_zones(PROFILE_ZONE_NODE* node)
+	{
+		while (node)
+		{
+			PROFILE_ZONE_NODE* next = node->next;
+			delete_zones(node->children);
+			delete node;
+			node = next;
+		}
+	}
+
+	void profile_report()
+	{
+		PROFILE_ZONE_NODE root;
+		root.children = nullptr;
+
+		for (PROFILE_ZONE_THREAD* thread = s_zone_threads.load(std::memory_order_acquire); thread; thread = thread->next)
+			merge_zones(&root, &thread->root);
+
+		log("%-40s %10s %12s %12s %12s %12s\n", "zone", "calls", "total ms", "avg us", "min us", "max us");
+		log_zones(root.children, 0);
+
+		delete_zones(root.children);
+	}
+
+	static void profile_report_at_exit()
+	{
+		if (s_zone_threads.load(std::memory_order_acquire))
+			profile_report();
+	}
+}
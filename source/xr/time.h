@@ -10,9 +10,39 @@ namespace xr
 
 		void	reset();
 		u32		measure_duration_ms();
+		u64		measure_duration_us();
+		u64		measure_duration_ns();
 	private:
 		u64		m_ticks;
 	};
 
 	u32 get_time_ms();
-}
\ No newline at end of file
+	u64 get_time_ns();	// monotonic, since application start
+
+	u64 get_ticks();
+	u64 get_ticks_frequency();	// ticks per second
+	u64 ticks_to_ns(u64 ticks);
+
+	// raw cpu timestamp counter; not synchronized between cores, use it for cycle counts of short kernels
+	u64 get_cycles();
+
+	// PROFILE_ZONE("name") times the rest of the enclosing scope. zones nest per thread, so the same zone
+	// entered under two different parents is counted separately. call counts and total/min/max times are
+	// merged over all threads by zone path and logged at exit. 'name' must be a string literal
+	struct PROFILE_ZONE_NODE;
+
+	struct PROFILE_ZONE_SCOPE
+	{
+		PROFILE_ZONE_SCOPE(const char* name);
+		~PROFILE_ZONE_SCOPE();
+	private:
+		PROFILE_ZONE_NODE*	m_node;
+		u64					m_ticks;
+	};
+
+	void profile_report();	// no zone may be active on other threads while reporting
+
+#define PROFILE_ZONE_CONCAT2(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) xr::PROFILE_ZONE_SCOPE PROFILE_ZONE_CONCAT(profile_zone_, __LINE__)(name)
+}
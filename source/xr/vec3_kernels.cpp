@@ -0,0 +1,159 @@
+#include <xr/vec3_kernels.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VEC3_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace xr
+{
+#ifdef VEC3_KERNELS_X86
+	namespace sse
+	{
+		struct VF { __m128 v; };
+		enum { W = 4 };
+
+		static inline VF load(const float* p) { VF r = { _mm_load_ps(p) }; return r; }
+		static inline VF loadu(const float* p) { VF r = { _mm_loadu_ps(p) }; return r; }
+		static inline void store(float* p, VF a) { _mm_store_ps(p, a.v); }
+		static inline void storeu(float* p, VF a) { _mm_storeu_ps(p, a.v); }
+		static inline VF set1(float f) { VF r = { _mm_set1_ps(f) }; return r; }
+		static inline VF add(VF a, VF b) { VF r = { _mm_add_ps(a.v, b.v) }; return r; }
+		static inline VF sub(VF a, VF b) { VF r = { _mm_sub_ps(a.v, b.v) }; return r; }
+		static inline VF mul(VF a, VF b) { VF r = { _mm_mul_ps(a.v, b.v) }; return r; }
+		static inline VF div(VF a, VF b) { VF r = { _mm_div_ps(a.v, b.v) }; return r; }
+		static inline VF sqrt(VF a) { VF r = { _mm_sqrt_ps(a.v) }; return r; }
+		static inline VF min(VF a, VF b) { VF r = { _mm_min_ps(a.v, b.v) }; return r; }	// a < b ? a : b, like Box3
+		static inline VF max(VF a, VF b) { VF r = { _mm_max_ps(a.v, b.v) }; return r; }
+
+		// the Vec3 at p + indices[j * stride] * 3 for each lane j
+		static inline void gather(const float* p, const int* indices, int stride, VF& gx, VF& gy, VF& gz)
+		{
+			const float* p0 = p + indices[0] * 3;
+			const float* p1 = p + indices[stride] * 3;
+			const float* p2 = p + indices[stride * 2] * 3;
+			const float* p3 = p + indices[stride * 3] * 3;
+			gx.v = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+			gy.v = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+			gz.v = _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]);
+		}
+		static inline void done() {}
+
+		#include <xr/vec3_kernels.inl>
+	}
+
+#if defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+	namespace avx2
+	{
+		struct VF { __m256 v; };
+		enum { W = 8 };
+
+		static inline VF load(const float* p) { VF r = { _mm256_load_ps(p) }; return r; }
+		static inline VF loadu(const float* p) { VF r = { _mm256_loadu_ps(p) }; return r; }
+		static inline void store(float* p, VF a) { _mm256_store_ps(p, a.v); }
+		static inline void storeu(float* p, VF a) { _mm256_storeu_ps(p, a.v); }
+		static inline VF set1(float f) { VF r = { _mm256_set1_ps(f) }; return r; }
+		static inline VF add(VF a, VF b) { VF r = { _mm256_add_ps(a.v, b.v) }; return r; }
+		static inline VF sub(VF a, VF b) { VF r = { _mm256_sub_ps(a.v, b.v) }; return r; }
+		static inline VF mul(VF a, VF b) { VF r = { _mm256_mul_ps(a.v, b.v) }; return r; }
+		static inline VF div(VF a, VF b) { VF r = { _mm256_div_ps(a.v, b.v) }; return r; }
+		static inline VF sqrt(VF a) { VF r = { _mm256_sqrt_ps(a.v) }; return r; }
+		static inline VF min(VF a, VF b) { VF r = { _mm256_min_ps(a.v, b.v) }; return r; }
+		static inline VF max(VF a, VF b) { VF r = { _mm256_max_ps(a.v, b.v) }; return r; }
+
+		static inline void gather(const float* p, const int* indices, int stride, VF& gx, VF& gy, VF& gz)
+		{
+			const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+			const __m256i index = _mm256_mullo_epi32(_mm256_i32gather_epi32(indices, offsets, 4), _mm256_set1_epi32(3));
+			gx.v = _mm256_i32gather_ps(p, index, 4);
+			gy.v = _mm256_i32gather_ps(p + 1, index, 4);
+			gz.v = _mm256_i32gather_ps(p + 2, index, 4);
+		}
+		// no penalty for the sse code that follows
+		static inline void done() { _mm256_zeroupper(); }
+
+		#include <xr/vec3_kernels.inl>
+	}
+#if defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+	static bool cpu_has_avx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// the os has to save the ymm registers too
+		__cpuid(info, 1);
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	static const bool s_avx2 = cpu_has_avx2();
+
+	#define VEC3_DISPATCH(call) do { if (s_avx2) { avx2::call; avx2::done(); } else sse::call; } while (0)
+#else
+	namespace scalar
+	{
+		struct VF { float v; };
+		enum { W = 1 };
+
+		static inline VF load(const float* p) { VF r = { *p }; return r; }
+		static inline VF loadu(const float* p) { VF r = { *p }; return r; }
+		static inline void store(float* p, VF a) { *p = a.v; }
+		static inline void storeu(float* p, VF a) { *p = a.v; }
+		static inline VF set1(float f) { VF r = { f }; return r; }
+		static inline VF add(VF a, VF b) { VF r = { a.v + b.v }; return r; }
+		static inline VF sub(VF a, VF b) { VF r = { a.v - b.v }; return r; }
+		static inline VF mul(VF a, VF b) { VF r = { a.v * b.v }; return r; }
+		static inline VF div(VF a, VF b) { VF r = { a.v / b.v }; return r; }
+		static inline VF sqrt(VF a) { VF r = { sqrtf(a.v) }; return r; }
+		static inline VF min(VF a, VF b) { VF r = { a.v < b.v ? a.v : b.v }; return r; }
+		static inline VF max(VF a, VF b) { VF r = { a.v > b.v ? a.v : b.v }; return r; }
+
+		static inline void gather(const float* p, const int* indices, int, VF& gx, VF& gy, VF& gz)
+		{
+			gx.v = p[*indices * 3];
+			gy.v = p[*indices * 3 + 1];
+			gz.v = p[*indices * 3 + 2];
+		}
+
+		#include <xr/vec3_kernels.inl>
+	}
+
+	#define VEC3_DISPATCH(call) scalar::call
+#endif
+
+	Box3 vec3_bounds(const Vec3* v, int size)
+	{
+		float box[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		VEC3_DISPATCH(interleaved_bounds(&v->x, size * 3, box));
+		return Box3(Vec3(box[0], box[1], box[2]), Vec3(box[3], box[4], box[5]));
+	}
+
+	void vec3_translate(Vec3* v, int size, Vec3 offset)
+	{
+		const float o[3] = { offset.x, offset.y, offset.z };
+		VEC3_DISPATCH(interleaved_translate(&v->x, size * 3, o));
+	}
+
+	void vec3_face_normals(const Vec3* positions, const int* indices, int stride, int num_faces, Vec3* normals)
+	{
+		VEC3_DISPATCH(face_normals(&positions->x, indices, stride, num_faces, &normals->x));
+	}
+}
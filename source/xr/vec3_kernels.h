@@ -0,0 +1,15 @@
+#pragma once
+
+#include <xr/core.h>
+#include <xr/math.h>
+
+namespace xr
+{
+	// geometry kernels straight on arrays of Vec3, AVX2 or SSE2 depending on the cpu and scalar off x86. they do
+	// the same float operations in the same order as the Vec3 operators, so the results match them exactly
+	Box3	vec3_bounds(const Vec3* v, int size);
+	void	vec3_translate(Vec3* v, int size, Vec3 offset);
+
+	// normalize(cross(p0 - p1, p0 - p2)) per face; a face is 3 vertex indices at 'indices + face * stride'
+	void	vec3_face_normals(const Vec3* positions, const int* indices, int stride, int num_faces, Vec3* normals);
+}
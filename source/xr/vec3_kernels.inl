@@ -0,0 +1,124 @@
+// the kernels of vec3_kernels.cpp, included once per instruction set inside a namespace that defines VF, W
+// and the vector operations below; intentionally without include guard
+
+	static inline void normalize(VF& x, VF& y, VF& z)
+	{
+		const VF inv_len = div(set1(1.0f), sqrt(add(add(mul(x, x), mul(y, y)), mul(z, z))));
+		x = mul(x, inv_len);
+		y = mul(y, inv_len);
+		z = mul(z, inv_len);
+	}
+
+	// positions and normals are arrays of Vec3 given as floats
+	static void face_normals(const float* p, const int* indices, int stride, int n, float* normals)
+	{
+		int f = 0;
+		for (; f + W <= n; f += W)
+		{
+			const int* face = indices + f * stride;
+			VF ax, ay, az, bx, by, bz, cx, cy, cz;
+			gather(p, face, stride, ax, ay, az);
+			gather(p, face + 1, stride, bx, by, bz);
+			gather(p, face + 2, stride, cx, cy, cz);
+
+			const VF v0x = sub(ax, bx), v0y = sub(ay, by), v0z = sub(az, bz);
+			const VF v1x = sub(ax, cx), v1y = sub(ay, cy), v1z = sub(az, cz);
+
+			VF x = sub(mul(v0y, v1z), mul(v0z, v1y));
+			VF y = sub(mul(v0z, v1x), mul(v0x, v1z));
+			VF z = sub(mul(v0x, v1y), mul(v0y, v1x));
+			normalize(x, y, z);
+
+			alignas(32) float lanes[3][W];
+			store(lanes[0], x);
+			store(lanes[1], y);
+			store(lanes[2], z);
+			for (int j = 0; j < W; ++j)
+			{
+				normals[(f + j) * 3] = lanes[0][j];
+				normals[(f + j) * 3 + 1] = lanes[1][j];
+				normals[(f + j) * 3 + 2] = lanes[2][j];
+			}
+		}
+		for (; f < n; ++f)
+		{
+			const int* face = indices + f * stride;
+			const float* a = p + face[0] * 3;
+			const float* b = p + face[1] * 3;
+			const float* c = p + face[2] * 3;
+
+			const float v0x = a[0] - b[0], v0y = a[1] - b[1], v0z = a[2] - b[2];
+			const float v1x = a[0] - c[0], v1y = a[1] - c[1], v1z = a[2] - c[2];
+
+			const float x = v0y * v1z - v0z * v1y;
+			const float y = v0z * v1x - v0x * v1z;
+			const float z = v0x * v1y - v0y * v1x;
+			const float inv_len = 1.0f / sqrtf(x * x + y * y + z * z);
+
+			normals[f * 3] = x * inv_len;
+			normals[f * 3 + 1] = y * inv_len;
+			normals[f * 3 + 2] = z * inv_len;
+		}
+	}
+
+	// interleaved x, y, z floats: 3 vectors hold W whole Vec3, lane j of vector k is component (k * W + j) % 3
+	static void interleaved_bounds(const float* f, int n, float* box)
+	{
+		alignas(32) float init[2][3 * W];
+		for (int j = 0; j < 3 * W; ++j)
+		{
+			init[0][j] = box[j % 3];
+			init[1][j] = box[3 + j % 3];
+		}
+		VF mins[3], maxs[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			mins[k] = load(init[0] + k * W);
+			maxs[k] = load(init[1] + k * W);
+		}
+
+		int i = 0;
+		for (; i + 3 * W <= n; i += 3 * W)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				const VF v = loadu(f + i + k * W);
+				mins[k] = min(v, mins[k]);
+				maxs[k] = max(v, maxs[k]);
+			}
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			store(init[0] + k * W, mins[k]);
+			store(init[1] + k * W, maxs[k]);
+		}
+		for (int j = 0; j < 3 * W; ++j)
+		{
+			box[j % 3] = init[0][j] < box[j % 3] ? init[0][j] : box[j % 3];
+			box[3 + j % 3] = init[1][j] > box[3 + j % 3] ? init[1][j] : box[3 + j % 3];
+		}
+		for (; i < n; ++i)
+		{
+			box[i % 3] = f[i] < box[i % 3] ? f[i] : box[i % 3];
+			box[3 + i % 3] = f[i] > box[3 + i % 3] ? f[i] : box[3 + i % 3];
+		}
+	}
+
+	static void interleaved_translate(float* f, int n, const float* offset)
+	{
+		alignas(32) float pattern[3 * W];
+		for (int j = 0; j < 3 * W; ++j)
+			pattern[j] = offset[j % 3];
+		VF offsets[3];
+		for (int k = 0; k < 3; ++k)
+			offsets[k] = load(pattern + k * W);
+
+		int i = 0;
+		for (; i + 3 * W <= n; i += 3 * W)
+		{
+			for (int k = 0; k < 3; ++k)
+				storeu(f + i + k * W, add(loadu(f + i + k * W), offsets[k]));
+		}
+		for (; i < n; ++i)
+			f[i] = f[i] + offset[i % 3];
+	}
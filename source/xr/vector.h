@@ -7,10 +7,10 @@ namespace xr
 	template< class T, bool POD = true > class VECTOR
 	{
 	public:
-		VECTOR() : m_ptr(nullptr), m_size(0), m_capacity(0)
+		VECTOR() : m_ptr(nullptr), m_size(0), m_capacity(0), m_external(false)
 		{
 		}
-		VECTOR(int size) : m_ptr(nullptr), m_size(0), m_capacity(0)
+		VECTOR(int size) : m_ptr(nullptr), m_size(0), m_capacity(0), m_external(false)
 		{
 			set_capacity(size);
 		}
@@ -19,12 +19,15 @@ namespace xr
 			m_ptr = rhs.m_ptr;
 			m_size = rhs.m_size;
 			m_capacity = rhs.m_capacity;
+			m_external = rhs.m_external;
 			rhs.m_ptr = nullptr;
 			rhs.m_size = rhs.m_capacity = 0;
+			rhs.m_external = false;
 		}
 		~VECTOR()
 		{
-			delete[] m_ptr;
+			if (!m_external)
+				delete[] m_ptr;
 		}
 		void push_back(const T& x)
 		{
@@ -37,7 +40,7 @@ namespace xr
 		void resize(int size)
 		{
 			if (m_capacity && size > m_capacity)
-				grow();
+				set_capacity(Max(size, m_capacity * 2));
 			else if (m_capacity == 0)
 				set_capacity(size);
 			m_size = size;
@@ -54,6 +57,24 @@ namespace xr
 		{
 			m_size = 0;
 		}
+		// frees the storage, or lets go of external memory
+		void reset()
+		{
+			if (!m_external)
+				delete[] m_ptr;
+			m_ptr = nullptr;
+			m_size = m_capacity = 0;
+			m_external = false;
+		}
+		// uses memory the vector doesn't own, like a mapped file, until it has to grow and copies out of it
+		void set_external(T* ptr, int size)
+		{
+			reset();
+			m_ptr = ptr;
+			m_size = m_capacity = size;
+			m_external = true;
+		}
+		bool external() const { return m_external; }
 		bool empty() const
 		{
 			return m_size == 0;
@@ -70,7 +91,9 @@ namespace xr
 		}
 		void operator = (const VECTOR<T>& rhs)
 		{
-			delete[] m_ptr;
+			if (!m_external)
+				delete[] m_ptr;
+			m_external = false;
 			m_size = m_capacity = rhs.size();
 			m_ptr = new T[m_size];
 			memcpy(m_ptr, rhs.m_ptr, m_size * sizeof(T));
@@ -79,12 +102,14 @@ namespace xr
 		{
 			if (this == &rhs) return;
 
-			clear();
+			reset();
 			m_ptr = rhs.m_ptr;
 			m_size = rhs.m_size;
 			m_capacity = rhs.m_capacity;
+			m_external = rhs.m_external;
 			rhs.m_ptr = nullptr;
 			rhs.m_size = rhs.m_capacity = 0;
+			rhs.m_external = false;
 		}
 		void fill(const T& x)
 		{
@@ -95,7 +120,7 @@ namespace xr
 		{
 			if (m_size + (end - begin) > m_capacity)
 			{
-				grow();
+				set_capacity(Max(int(m_size + (end - begin)), Max(32, m_capacity * 2)));
 			}
 			memcpy(m_ptr + m_size, begin, (end - begin) * sizeof(T));
 			m_size += end - begin;
@@ -112,6 +137,7 @@ namespace xr
 			Swap(m_ptr, rhs.m_ptr);
 			Swap(m_size, rhs.m_size);
 			Swap(m_capacity, rhs.m_capacity);
+			Swap(m_external, rhs.m_external);
 		}
 
 	private:
@@ -122,9 +148,11 @@ namespace xr
 			if (m_ptr)
 			{
 				memcpy(ptr, m_ptr, m_size * sizeof(T));
-				delete m_ptr;
+				if (!m_external)
+					delete m_ptr;
 			}
 			m_ptr = ptr;
+			m_external = false;
 		}
 		void set_size(int new_size)
 		{
@@ -144,7 +172,8 @@ namespace xr
 			set_capacity(Max(32, m_capacity * 2));
 		}
 
-		T*	m_ptr;
-		int	m_size, m_capacity;
+		T*		m_ptr;
+		int		m_size, m_capacity;
+		bool	m_external;	// m_ptr isn't ours to free
 	};
 }
\ No newline at end of file